@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Domain blocklist compiled offline by `dns_blocklist_compile` into an
+// mmap-able reversed-label suffix trie. Blocking a name blocks all of its
+// subdomains, so entries below an already-blocked name are dropped at build
+// time. Lookup walks one trie level per label (binary search over the sorted
+// children) and never allocates.
+//
+// Image layout (host byte order):
+//   BlocklistImageHeader
+//   BlockNode nodes[node_count]     // nodes[0] is the root; children contiguous
+//   label pool                      // lower-cased labels, deduplicated
+
+constexpr char BLOCKLIST_IMAGE_MAGIC[8] = {'D', 'N', 'S', 'B', 'L', 'K', '0', '1'};
+constexpr uint32_t BLOCKLIST_IMAGE_VERSION = 1;
+
+#pragma pack(push, 1)
+struct BlocklistImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t node_count;
+    uint64_t domain_count; // entries kept after suffix pruning
+    uint64_t nodes_off;
+    uint64_t pool_off;
+    uint64_t file_size;
+};
+
+struct BlockNode
+{
+    uint32_t label_off; // into pool
+    uint8_t label_len;
+    uint8_t blocked; // 1: this name and everything below it is blocked
+    uint16_t reserved;
+    uint32_t first_child;
+    uint32_t child_count;
+};
+#pragma pack(pop)
+
+class Blocklist
+{
+public:
+    Blocklist() = default;
+    ~Blocklist();
+    Blocklist(const Blocklist &) = delete;
+    Blocklist &operator=(const Blocklist &) = delete;
+
+    // Maps and validates an image. Returns false (and logs) on error.
+    bool open(const std::string &path);
+
+    // True if `name` or any parent domain of it is listed (case-insensitive).
+    bool blocked(std::string_view name) const;
+
+    uint32_t node_count() const { return hdr_ ? hdr_->node_count : 0; }
+    uint64_t domain_count() const { return hdr_ ? hdr_->domain_count : 0; }
+    size_t image_bytes() const { return len_; }
+
+private:
+    const uint8_t *base_ = nullptr;
+    size_t len_ = 0;
+    const BlocklistImageHeader *hdr_ = nullptr;
+    const BlockNode *nodes_ = nullptr;
+    const uint8_t *pool_ = nullptr;
+};
+
+// Holds the active blocklist and swaps it atomically on reload. Readers take a
+// snapshot with current(); an old image stays mapped until its last reader
+// drops the snapshot, so query handling never pauses for a reload.
+class BlocklistHandle
+{
+public:
+    bool reload(const std::string &path);
+    std::shared_ptr<const Blocklist> current() const;
+
+private:
+    std::shared_ptr<const Blocklist> active_;
+};
+
+// Reads blocklist sources: plain "domain" lines, hosts-style
+// "0.0.0.0 domain" lines and adblock-style "||domain^" lines. '#'/'!' comments.
+bool parse_blocklist_source(const std::string &path, std::vector<std::string> &out);
+
+// Builds the pruned suffix trie and writes the image. Returns false on error.
+bool compile_blocklist_image(const std::vector<std::string> &domains, const std::string &out_path);
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "lru_ttl_cache.h"
+
+// Answer cache as used by the CLI: "domain|qtype" -> answers.
+using DnsAnswerCache = LruTtlCache<std::string, std::vector<std::string>>;
+
+// Versioned binary snapshot of a DnsAnswerCache for warm restarts.
+// Expiry is stored as absolute wall-clock seconds so a snapshot taken before a
+// restart (or on another process) is still meaningful; entries that expired
+// in between are skipped on load. Entries are stored LRU -> MRU.
+//
+// Layout (host byte order):
+//   CacheSnapshotHeader
+//   entry*: i64 expires_at | u16 key_len | key | u16 answer_count |
+//           (u16 len | bytes)*
+
+constexpr char CACHE_SNAPSHOT_MAGIC[8] = {'D', 'N', 'S', 'S', 'N', 'A', 'P', '1'};
+constexpr uint32_t CACHE_SNAPSHOT_VERSION = 1;
+
+#pragma pack(push, 1)
+struct CacheSnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t entry_count;
+    int64_t created_at; // wall-clock seconds
+};
+#pragma pack(pop)
+
+// Writes via temp file + rename. Returns false (and logs) on error.
+bool save_cache_snapshot(const DnsAnswerCache &cache, const std::string &path);
+
+// mmaps the snapshot and bulk-inserts unexpired entries. A missing file is
+// not an error (cold start); `loaded` receives the number of entries inserted.
+bool load_cache_snapshot(DnsAnswerCache &cache, const std::string &path, size_t *loaded = nullptr);
@@ -0,0 +1,91 @@
+#pragma once
+#include "resolver.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CNAME-aware access to a "name|qtype" -> answers cache.
+//
+// A resolved chain is not flattened into one entry under the queried name.
+// Each link is cached as the owner's CNAME RRset ("owner|5" -> {target}) and
+// the addresses under the name that owns them ("target|1"), each with its own
+// TTL. Aliases of the same target then share one copy of its answers, and
+// when the target's short TTL runs out only the target is asked for again.
+
+constexpr uint16_t QTYPE_CNAME = 5;
+constexpr size_t MAX_CACHED_CHAIN = 8; // links followed before going upstream
+
+inline std::string cache_key(const std::string &name, uint16_t qtype)
+{
+    return name + "|" + std::to_string(qtype);
+}
+
+struct ChainLookup
+{
+    std::string tail;          // first name without a cached answer; empty on a hit
+    uint32_t ttl = UINT32_MAX; // shortest TTL left along the links (and the answer on a hit)
+    size_t links = 0;          // CNAME links taken from the cache
+};
+
+// `get(key, answers, ttl_left, probe)` is a single cache lookup; `probe` is
+// set for the CNAME lookups, which miss for every name that is not an alias.
+// Returns true with the answers of the end of the chain. On false,
+// `out.tail` is the name to resolve next, and the links before it have been
+// followed already.
+template <class Get>
+bool chain_get(const std::string &name, uint16_t qtype, Get &&get,
+               std::vector<std::string> &answers, ChainLookup &out)
+{
+    out = ChainLookup{};
+    out.tail = name;
+    uint32_t ttl_left = 0;
+    for (;;)
+    {
+        if (get(cache_key(out.tail, qtype), answers, ttl_left, false))
+        {
+            out.ttl = std::min(out.ttl, ttl_left);
+            out.tail.clear();
+            return true;
+        }
+        // Only address lookups are chased, as in resolve_with_ttl()
+        if ((qtype != 1 && qtype != 28) || out.links == MAX_CACHED_CHAIN ||
+            !get(cache_key(out.tail, QTYPE_CNAME), answers, ttl_left, true) || answers.empty())
+        {
+            answers.clear();
+            return false;
+        }
+        out.ttl = std::min(out.ttl, ttl_left);
+        out.tail = std::move(answers.front());
+        answers.clear();
+        out.links++;
+    }
+}
+
+// Caches what resolving `name` returned: each link of res.chain under its
+// owner, then the answers (or NXDOMAIN) under the last target. TTL policy as
+// before: NXDOMAIN is kept at least 60s, and a zero TTL is cached for 60s.
+// `put(key, answers, ttl)` is a single cache insert.
+template <class Put>
+void chain_put(const std::string &name, uint16_t qtype, const DnsResult &res, Put &&put)
+{
+    const std::string *owner = &name;
+    for (const CnameLink &link : res.chain)
+    {
+        put(cache_key(*owner, QTYPE_CNAME), std::vector<std::string>{link.target},
+            link.ttl == 0 ? 60 : link.ttl);
+        owner = &link.target;
+    }
+    if (res.answers.empty() && !res.nxdomain)
+        return;
+    uint32_t ttl = res.nxdomain ? std::max<uint32_t>(res.answer_ttl, 60) : res.answer_ttl;
+    put(cache_key(*owner, qtype), res.answers, ttl == 0 ? 60 : ttl);
+}
+
+// TTL of the flattened answer handed back to the client
+inline uint32_t chain_answer_ttl(const ChainLookup &look, const DnsResult &res)
+{
+    uint32_t ttl = res.nxdomain ? std::max<uint32_t>(res.min_ttl, 60) : res.min_ttl;
+    return std::min(ttl, look.ttl);
+}
@@ -3,6 +3,17 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <memory_resource>
 
 int send_query(std::vector<uint8_t> &packet, const std::string &server_ip, uint16_t port);
-std::vector<uint8_t> recv_response(int sockfd, int timeout);
\ No newline at end of file
+std::vector<uint8_t> recv_response(int sockfd, int timeout);
+
+// Arena-friendly variants: no temporaries, the response is received into `out`
+// (resized to MAX_DNS_RESPONSE, then shrunk). Returns false on error/timeout.
+int send_query(const std::pmr::vector<uint8_t> &packet, const std::pmr::string &server_ip, uint16_t port);
+bool recv_response(int sockfd, int timeout, std::pmr::vector<uint8_t> &out);
+
+// Receives the replies to `n` queries sent back to back, all against one
+// deadline `timeout` seconds from now instead of `timeout` each. ok[i] says
+// whether out[i] holds a reply; sockfds < 0 are skipped, the rest are consumed.
+void recv_responses(const int *sockfds, size_t n, int timeout, std::pmr::vector<uint8_t> *out, bool *ok);
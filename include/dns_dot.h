@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+// DNS-over-TLS (RFC 7858) underneath send_query/recv_response.
+//
+// When enabled, every upstream exchange goes over TLS to the same address on
+// DotOptions::port instead of UDP. One connection per upstream stays open and
+// is shared by all threads. Queries are pipelined on it: each one gets a
+// connection-unique message ID (the caller's ID is restored on the reply), and
+// replies are matched by ID in whatever order they arrive. When a connection
+// has to be reopened, the session ticket from the previous one is offered so
+// the handshake is resumed rather than run in full.
+//
+// The certificate is checked against the system trust store (or ca_file) and
+// against server_name, or against the upstream's IP address when no name is
+// set.
+
+struct DotOptions
+{
+    uint16_t port = 853;
+    std::string ca_file;           // PEM bundle; empty = system trust store
+    std::string server_name;       // SNI and expected certificate name
+    bool reuse_connections = true; // false: one connection per query
+    bool session_tickets = true;   // resume with the upstream's last ticket
+};
+
+// Counted since the last dot_enable()
+struct DotStats
+{
+    uint64_t queries = 0;
+    uint64_t handshakes = 0; // full and resumed
+    uint64_t resumed = 0;
+    uint64_t max_in_flight = 0; // most queries pipelined on one connection
+};
+
+bool dot_enable(const DotOptions &opts);
+void dot_disable(); // back to UDP; drops connections and tickets
+bool dot_enabled();
+DotStats dot_stats();
+
+// Hooks for dns_client.cpp; handles are not file descriptors
+int dot_send(const uint8_t *query, size_t len, const char *server_ip);
+ssize_t dot_recv(int handle, int timeout_secs, uint8_t *buf, size_t cap);
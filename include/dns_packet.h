@@ -1,7 +1,9 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory_resource>
 
 // DNS header (network byte order in the wire buffer; host order when copied)
 #pragma pack(push, 1)
@@ -28,7 +30,21 @@ struct DNSResourceRecord
 
 uint16_t generate_transaction_id();
 std::vector<uint8_t> build_query_packet(const std::string &domain, uint16_t qtype);
+// Builds into `out` (cleared first) so the resolver can reuse an arena buffer.
+void build_query_packet(std::string_view domain, uint16_t qtype, std::pmr::vector<uint8_t> &out);
 
 // Simple extractor used in the older path (returns strings only)
 std::vector<std::string> parse_response(const std::vector<uint8_t> &msg,
                                         uint16_t expected_qtype /*0 = any*/);
+
+// Server side: reads the first question of a client query (name lowercased,
+// no trailing dot). Returns false for malformed or non-query packets.
+bool parse_query_question(const uint8_t *msg, size_t len, std::string &name, uint16_t &qtype);
+
+// Builds the reply to `query` (ID and question echoed, QR/RA set) carrying
+// `answers` as RRs of `qtype` with `ttl`. `rcode` 3 = NXDOMAIN, 2 = SERVFAIL.
+// Answers are in the cache's string form (IP literals, or target names for
+// CNAME/MX). Returns false if the query has no complete question.
+bool build_response_packet(const uint8_t *query, size_t query_len, uint16_t qtype,
+                           const std::vector<std::string> &answers, uint32_t ttl,
+                           uint8_t rcode, std::vector<uint8_t> &out);
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include "mpsc_queue.h"
+
+// UDP listener for serve mode. Two backends share one handler contract:
+//
+//   IoUring: one multishot RECVMSG into a provided buffer ring, so a single
+//            SQE keeps receiving; replies are copied into registered buffers
+//            and every reply produced by one pass over the completion queue
+//            is submitted with one io_uring_enter.
+//   Epoll:   recvmmsg/sendmmsg in batches of up to 64 datagrams per wakeup.
+//
+// ServerIo::Auto uses io_uring and falls back to epoll when the kernel lacks
+// io_uring, provided buffer rings (5.19) or multishot receive (6.0).
+
+enum class ServerIo
+{
+    Auto,
+    IoUring,
+    Epoll,
+};
+
+struct ServerOptions
+{
+    std::string listen_ip = "127.0.0.1";
+    uint16_t port = 5353;
+    ServerIo io = ServerIo::Auto;
+};
+
+struct ServerStats
+{
+    size_t received = 0;
+    size_t sent = 0;
+    size_t dropped = 0;   // no send slot / send error
+    size_t syscalls = 0;  // io_uring_enter or recvmmsg/sendmmsg/epoll_wait
+};
+
+class UdpServer
+{
+public:
+    // Returns true with `response` filled to answer now; false to answer
+    // later through reply() (or not at all). Runs on the loop thread.
+    using Handler = std::function<bool(const uint8_t *query, size_t len, const sockaddr_in &from,
+                                       std::vector<uint8_t> &response)>;
+
+    UdpServer() = default;
+    ~UdpServer();
+    UdpServer(const UdpServer &) = delete;
+    UdpServer &operator=(const UdpServer &) = delete;
+
+    bool open(const ServerOptions &opts);
+
+    // Serves until `stop` becomes non-zero. Returns false on a fatal error.
+    bool run(const Handler &handler, const volatile std::sig_atomic_t &stop);
+
+    // Thread-safe and lock-free: queues a deferred response and wakes the loop.
+    void reply(const sockaddr_in &to, std::vector<uint8_t> response);
+
+    ServerIo backend() const { return backend_; }
+    const ServerStats &stats() const { return stats_; }
+
+private:
+    struct Deferred
+    {
+        sockaddr_in to{};
+        std::vector<uint8_t> response;
+    };
+
+    bool run_epoll(const Handler &handler, const volatile std::sig_atomic_t &stop);
+    // 1 = ran to completion, 0 = io_uring unsupported (nothing served), -1 = error
+    int run_uring(const Handler &handler, const volatile std::sig_atomic_t &stop);
+    void take_deferred(std::vector<Deferred> &out);
+
+    int sock_ = -1;
+    int wake_fd_ = -1; // eventfd written by reply()
+    ServerIo requested_ = ServerIo::Auto;
+    ServerIo backend_ = ServerIo::Epoll;
+    ServerStats stats_;
+    MpscQueue<Deferred> deferred_; // resolver workers push, the loop pops
+    std::atomic<bool> wake_pending_{false};
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+// Record/replay layer underneath send_query/recv_response.
+//
+// Record: live exchanges are appended to a capture file together with the
+// upstream latency (timeouts are recorded too). Replay: the capture is loaded
+// into memory and every query is answered from it, keyed by upstream address and
+// question section (transaction IDs are rewritten), either once the original
+// latency has passed since the send (so overlapping queries overlap again) or
+// immediately. Repeated identical questions are served in recorded
+// order, repeating the last one when the capture runs out.
+//
+// Capture file (host byte order):
+//   "DNSCAP01"
+//   record*: u16 server_len | server ("ip:port") | u16 query_len | query |
+//            i32 response_len (-1 = no response) | response | u64 latency_us
+
+enum class TransportMode
+{
+    Live,
+    Record,
+    Replay,
+};
+
+bool transport_start_recording(const std::string &path);
+bool transport_start_replay(const std::string &path, bool zero_latency);
+void transport_stop(); // back to Live; flushes/closes the capture
+TransportMode transport_mode();
+
+// Hooks for dns_client.cpp
+int transport_replay_send(const uint8_t *query, size_t len, const char *server_ip, uint16_t port);
+ssize_t transport_replay_recv(int handle, uint8_t *buf, size_t cap);
+void transport_record_send(int sockfd, const uint8_t *query, size_t len, const char *server_ip, uint16_t port);
+void transport_record_recv(int sockfd, const uint8_t *response, ssize_t len);
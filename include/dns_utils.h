@@ -3,8 +3,11 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <memory_resource>
 
 std::vector<uint8_t> encode_domain(const std::string &domain);
+void encode_domain(std::string_view domain, std::vector<uint8_t> &out); // appends
 std::string decode_domain(const std::vector<uint8_t> &data, size_t &offset);
 std::string current_timestamp();
 void log_info(const std::string &message);
@@ -15,4 +18,12 @@ bool is_ip_literal(const std::string &s);
 void skip_rr(const std::vector<uint8_t> &buf, size_t &off);
 uint16_t read_u16(const std::vector<uint8_t> &buf, size_t pos);
 uint32_t read_u32(const std::vector<uint8_t> &buf, size_t pos);
-uint16_t read16(const std::vector<uint8_t> &buf, size_t pos);
\ No newline at end of file
+uint16_t read16(const std::vector<uint8_t> &buf, size_t pos);
+
+// Arena-backed variants used by the resolver miss path. Decoded names are
+// allocated from the same memory resource as the buffer they came from.
+void encode_domain(std::string_view domain, std::pmr::vector<uint8_t> &out); // appends
+std::pmr::string decode_domain(const std::pmr::vector<uint8_t> &data, size_t &offset);
+void skip_rr(const std::pmr::vector<uint8_t> &buf, size_t &off);
+uint16_t read_u16(const std::pmr::vector<uint8_t> &buf, size_t pos);
+uint32_t read_u32(const std::pmr::vector<uint8_t> &buf, size_t pos);
\ No newline at end of file
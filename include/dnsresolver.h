@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Public interface of libdnsresolver (`make lib`). Only standard types appear
+// here and the implementation sits behind a pointer, so internal changes do
+// not change the layout of DnsResolver or require callers to rebuild.
+
+#define DNSRESOLVER_API_VERSION 1
+
+struct DnsResolverOptions
+{
+    size_t cache_entries = 512; // ignored when cache_bytes != 0
+    size_t cache_bytes = 0;     // bound the cache by charged bytes instead
+    bool tinylfu = false;       // W-TinyLFU admission (see --cache-policy)
+    unsigned workers = 4;       // threads resolving cache misses
+    bool hot_cache = true;      // per-thread L1 of hot names in front of the cache
+    bool flood_guard = false;   // shed random-subdomain floods (see flood_guard.h)
+};
+
+struct DnsQuery
+{
+    std::string name;
+    uint16_t qtype = 1;
+};
+
+struct DnsAnswer
+{
+    std::string name;
+    uint16_t qtype = 1;
+    std::vector<std::string> answers;
+    uint32_t ttl = 0; // seconds left on a hit, TTL cached on a miss
+    bool nxdomain = false;
+    bool cached = false; // served from the cache
+    bool shed = false;   // NXDOMAIN made up by the flood guard; nothing went upstream
+};
+
+struct DnsAddresses
+{
+    DnsAnswer a;    // qtype 1
+    DnsAnswer aaaa; // qtype 28
+};
+
+// Flood guard counters; all zero when it is off
+struct DnsFloodStats
+{
+    uint64_t shed = 0;     // misses answered NXDOMAIN without an upstream query
+    uint64_t probes = 0;   // unknown names under a defended zone sent upstream anyway
+    uint64_t triggers = 0; // times a zone's NXDOMAIN rate started a defence
+};
+
+struct DnsBatch
+{
+    uint64_t id = 0;
+    std::vector<DnsAnswer> results; // in submission order
+};
+
+class DnsResolver
+{
+public:
+    explicit DnsResolver(const DnsResolverOptions &opts = DnsResolverOptions());
+    ~DnsResolver(); // resolves everything already submitted, then joins
+    DnsResolver(const DnsResolver &) = delete;
+    DnsResolver &operator=(const DnsResolver &) = delete;
+
+    // Blocking lookup through the resolver's cache.
+    DnsAnswer resolve(const std::string &name, uint16_t qtype);
+
+    // Both address families. Each is cached on its own; when neither is
+    // cached the A and AAAA queries are in flight together, so the pair costs
+    // about one upstream round trip.
+    DnsAddresses resolve_addresses(const std::string &name);
+
+    // Cache only, never touches the network. Returns false on a miss.
+    bool lookup_cached(const std::string &name, uint16_t qtype, DnsAnswer &out);
+
+    using BatchCallback = std::function<void(DnsBatch &batch)>;
+
+    // Batch lookup in the style of getaddrinfo_a. Cache hits are answered
+    // inside submit(); misses go to the worker threads, which steal from each
+    // other's queues, so a miss stuck on a slow upstream holds up no other.
+    // When the last one is done, `done` runs on that worker (or inside
+    // submit() if all were hits). Returns the batch id.
+    uint64_t submit(std::vector<DnsQuery> queries, BatchCallback done);
+
+    // For queries lookup_cached() has just missed: goes straight to the
+    // workers (or the flood guard) without a second cache lookup, so each
+    // miss is counted once.
+    uint64_t submit_missed(std::vector<DnsQuery> queries, BatchCallback done);
+
+    // Same, but finished batches are queued and completion_fd() (an eventfd)
+    // becomes readable; collect them with take_completed().
+    uint64_t submit(std::vector<DnsQuery> queries);
+    int completion_fd() const;
+    size_t take_completed(std::vector<DnsBatch> &out); // appends; returns count
+
+    // L1 = per-thread hot-name slots, L2 = the shared cache. A lookup is an
+    // L1 hit, an L2 hit (cache_hits) or a miss (cache_misses). Other threads'
+    // L1 hits are published in chunks of 1024 and when the thread exits, so
+    // l1_hits() may lag while they run.
+    size_t l1_hits() const;
+    size_t cache_hits() const;
+    size_t cache_misses() const;
+    size_t cache_rejected() const; // answers too big for the whole cache, not stored
+    size_t cache_size() const;
+
+    DnsFloodStats flood_stats() const;
+
+    // Warm restarts through a cache snapshot (see cache_snapshot.h). Both
+    // hold the cache lock, so lookups that miss L1 wait while they run.
+    bool load_snapshot(const std::string &path, size_t *loaded = nullptr);
+    bool save_snapshot(const std::string &path) const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Random-subdomain ("water torture") flood defence.
+//
+// Upstream outcomes are counted per zone: the registrable domain of the
+// queried name, as in <random>.<random>.victim.example -> victim.example
+// (three labels under co.uk-style suffixes). Counters halve
+// every window, so they follow the last few windows of traffic. When a
+// zone's NXDOMAIN count and share both cross a threshold, the zone is
+// defended for hold_sec. While it is, a cache miss under it only goes
+// upstream if the name has been seen to exist, or as one of a few probes
+// per second. Every other miss is answered NXDOMAIN locally and counts as
+// one, so the defence lasts as long as the flood does.
+//
+// Memory is fixed: a direct-mapped table of ZONE_SLOTS zone counters and two
+// generations of a blocked Bloom filter of existing names. When the current
+// generation has taken its share of names, it becomes the old one and the
+// previous old one is dropped.
+
+struct FloodGuardOptions
+{
+    size_t filter_bytes = 1 << 20;  // per filter generation
+    uint32_t window_sec = 1;
+    uint32_t min_nxdomain = 50;     // decayed NXDOMAIN count before a zone can trigger
+    double nxdomain_share = 0.5;    // ... and their share of the zone's lookups
+    uint32_t hold_sec = 60;         // defence lasts this long past the last trigger
+    uint32_t probes_per_sec = 5;    // unknown names still sent upstream per zone
+};
+
+struct FloodGuardStats
+{
+    uint64_t shed = 0;     // misses answered NXDOMAIN locally
+    uint64_t probes = 0;   // unknown names sent upstream while defended
+    uint64_t triggers = 0; // times a zone started being defended
+};
+
+// Bloom filter whose k bits for a key all sit in one 64-byte block, so a
+// lookup touches a single cache line
+class BlockedBloomFilter
+{
+public:
+    explicit BlockedBloomFilter(size_t bytes);
+
+    void insert(uint64_t hash);
+    bool may_contain(uint64_t hash) const;
+    void clear();
+    size_t capacity() const { return blocks_.size() * 512 / BITS_PER_KEY; } // ~1% false positives
+
+private:
+    static constexpr size_t BITS_PER_KEY = 10;
+
+    struct alignas(64) Block
+    {
+        uint64_t words[8];
+    };
+    std::vector<Block> blocks_;
+};
+
+class FloodGuard
+{
+public:
+    explicit FloodGuard(const FloodGuardOptions &opts = FloodGuardOptions());
+
+    // True when a cache miss for `name` should get NXDOMAIN without an
+    // upstream query
+    bool should_shed(std::string_view name);
+
+    // Records what the upstream said about `name`
+    void observe(std::string_view name, bool exists, bool nxdomain);
+
+    FloodGuardStats stats() const;
+
+private:
+    static constexpr size_t ZONE_SLOTS = 4096;
+
+    struct ZoneSlot
+    {
+        uint64_t tag = 0; // zone hash; 0 = free
+        uint32_t window_start = 0;
+        uint32_t lookups = 0;
+        uint32_t nxdomains = 0;
+        uint32_t defended_until = 0;
+        uint32_t probe_second = 0;
+        uint32_t probes = 0;
+    };
+
+    uint32_t now_sec() const;
+    bool known(uint64_t name_hash) const;
+    void age(ZoneSlot &z, uint32_t now) const;
+    void count(ZoneSlot &z, uint32_t now, bool nxdomain);
+
+    FloodGuardOptions opts_;
+    mutable std::mutex mutex_;
+    std::vector<ZoneSlot> zones_;
+    BlockedBloomFilter current_, previous_;
+    size_t current_names_ = 0;
+    FloodGuardStats stats_;
+    const std::chrono::steady_clock::time_point start_;
+};
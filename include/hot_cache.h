@@ -0,0 +1,77 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Small direct-mapped cache meant to live in thread_local storage in front of
+// a shared cache (L2). Each slot holds a private copy of an L2 entry together
+// with the owner's id and the owner's generation at copy time; a slot only
+// hits while both still match and the copy has not expired, so a hit reads
+// nothing but this thread's slots and one read-mostly generation counter.
+// Owners bump their generation whenever a live L2 entry changes.
+//
+// Two hot names mapping to one slot would evict each other on every lookup,
+// paying a copy each time; a live occupant is therefore only replaced after
+// REPLACE_AFTER L2 hits from other names with no L1 hit in between.
+template <class V, size_t Slots = 256>
+class HotCache
+{
+    static_assert((Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+    using Clock = std::chrono::steady_clock;
+
+    struct Slot
+    {
+        uint64_t owner = 0; // 0 = empty
+        uint64_t generation = 0;
+        uint16_t qtype = 0;
+        uint16_t conflicts = 0;
+        std::string name;
+        V value;
+        Clock::time_point expires_at;
+    };
+
+public:
+    static size_t hash_of(const std::string &name, uint16_t qtype)
+    {
+        return std::hash<std::string>{}(name) ^ (size_t(qtype) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    bool get(uint64_t owner, uint64_t generation, const std::string &name, uint16_t qtype, size_t hash,
+             V &out, uint32_t &ttl_left_sec)
+    {
+        Slot &s = slots_[hash & (Slots - 1)];
+        if (s.owner != owner || s.generation != generation || s.qtype != qtype || s.name != name)
+            return false;
+        auto now = Clock::now();
+        if (now >= s.expires_at)
+            return false;
+        s.conflicts = 0;
+        out = s.value;
+        ttl_left_sec = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::seconds>(s.expires_at - now).count());
+        return true;
+    }
+
+    void put(uint64_t owner, uint64_t generation, const std::string &name, uint16_t qtype, size_t hash,
+             const V &value, uint32_t ttl_sec)
+    {
+        Slot &s = slots_[hash & (Slots - 1)];
+        bool live = s.owner == owner && s.generation == generation && Clock::now() < s.expires_at;
+        if (live && ++s.conflicts < REPLACE_AFTER)
+            return;
+        s.conflicts = 0;
+        s.owner = owner;
+        s.generation = generation;
+        s.qtype = qtype;
+        s.name = name;
+        s.value = value;
+        s.expires_at = Clock::now() + std::chrono::seconds(ttl_sec);
+    }
+
+private:
+    static constexpr uint16_t REPLACE_AFTER = 4;
+
+    std::array<Slot, Slots> slots_;
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only, mmap-loaded image of local overrides (hosts / zone file data),
+// produced offline by `dns_zone_compile`. Records are keyed by (name, qtype)
+// and indexed by a minimal perfect hash, so a lookup is one hash probe plus a
+// key compare and never touches the heap.
+//
+// Image layout (host byte order):
+//   ZoneImageHeader
+//   uint32_t displacement[bucket_count]
+//   ZoneSlot slots[record_count]
+//   string pool: owner names, then per-record answers as [u8 len][bytes]...
+
+constexpr char ZONE_IMAGE_MAGIC[8] = {'D', 'N', 'S', 'Z', 'O', 'N', 'E', '1'};
+constexpr uint32_t ZONE_IMAGE_VERSION = 1;
+
+#pragma pack(push, 1)
+struct ZoneImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_count;
+    uint32_t bucket_count;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t disp_off;
+    uint64_t slots_off;
+    uint64_t pool_off;
+    uint64_t file_size;
+};
+
+struct ZoneSlot
+{
+    uint32_t name_off; // into pool
+    uint16_t name_len;
+    uint16_t qtype;
+    uint32_t ttl;
+    uint32_t answers_off; // into pool
+    uint16_t answer_count;
+    uint16_t reserved;
+};
+#pragma pack(pop)
+
+// Answers of one (name, qtype) record; views point into the mapped image.
+class ZoneAnswers
+{
+public:
+    ZoneAnswers() = default;
+    ZoneAnswers(const uint8_t *data, uint16_t count, uint32_t ttl)
+        : data_(data), count_(count), ttl_(ttl) {}
+
+    uint16_t count() const { return count_; }
+    uint32_t ttl() const { return ttl_; }
+
+    // Calls fn(std::string_view) for every answer in image order.
+    template <class Fn>
+    void for_each(Fn &&fn) const
+    {
+        const uint8_t *p = data_;
+        for (uint16_t i = 0; i < count_; ++i)
+        {
+            uint8_t len = *p++;
+            fn(std::string_view(reinterpret_cast<const char *>(p), len));
+            p += len;
+        }
+    }
+
+private:
+    const uint8_t *data_ = nullptr;
+    uint16_t count_ = 0;
+    uint32_t ttl_ = 0;
+};
+
+class LocalZone
+{
+public:
+    LocalZone() = default;
+    ~LocalZone();
+    LocalZone(const LocalZone &) = delete;
+    LocalZone &operator=(const LocalZone &) = delete;
+
+    // Maps and validates an image. Returns false (and logs) on error.
+    bool open(const std::string &path);
+    void close();
+
+    bool loaded() const { return base_ != nullptr; }
+    uint32_t size() const { return hdr_ ? hdr_->record_count : 0; }
+
+    // Case-insensitive lookup of `name` (a trailing dot is ignored).
+    bool lookup(std::string_view name, uint16_t qtype, ZoneAnswers &out) const;
+
+private:
+    const uint8_t *base_ = nullptr;
+    size_t len_ = 0;
+    const ZoneImageHeader *hdr_ = nullptr;
+    const uint32_t *disp_ = nullptr;
+    const ZoneSlot *slots_ = nullptr;
+    const uint8_t *pool_ = nullptr;
+};
+
+// One record fed to the compiler; names are normalised by the compiler.
+struct ZoneRecord
+{
+    std::string name;
+    uint16_t qtype;
+    uint32_t ttl;
+    std::vector<std::string> answers;
+};
+
+// Parses a hosts file ("IP name [alias...]") or a minimal master file
+// ("name [ttl] [IN] A|AAAA|CNAME|MX rdata", with $ORIGIN/$TTL). The format is
+// detected per line: a line whose first token is an IP literal is hosts-style.
+// Bad records are skipped with a warning; a bad TTL fails the whole file.
+bool parse_zone_source(const std::string &path, uint32_t default_ttl,
+                       std::vector<ZoneRecord> &out);
+
+// A TTL as decimal seconds that fit a u32; no unit suffixes ("1h").
+bool parse_zone_ttl(const std::string &s, uint32_t &out);
+
+// Merges records with the same (name, qtype), builds the perfect hash and
+// writes the image. Returns false (and logs) on error.
+bool compile_zone_image(std::vector<ZoneRecord> records, const std::string &out_path);
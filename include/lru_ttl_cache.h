@@ -1,27 +1,199 @@
 #pragma once
 #include <unordered_map>
 #include <list>
+#include <vector>
 #include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
 
-template <class K, class V>
+enum class CachePolicy
+{
+    Lru,      // plain LRU: every put is admitted, the LRU tail is evicted
+    WTinyLfu, // small LRU window + frequency-gated admission into the main LRU
+};
+
+// What put() did
+enum class CachePut
+{
+    Inserted,  // new key
+    Replaced,  // existing key, new value
+    Refreshed, // existing key, same value; only the expiry moved
+    Rejected,  // heavier than the whole capacity; nothing stored
+};
+
+enum class CacheLimit
+{
+    Entries, // capacity counts entries
+    Bytes,   // capacity counts charged bytes (see cache_charge below)
+};
+
+// Clock for LruTtlCache that only moves when told to, so a query trace can be
+// replayed in virtual time. Each thread has its own time, so simulations on
+// different threads don't disturb each other.
+struct ManualClock
+{
+    using duration = std::chrono::steady_clock::duration;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<ManualClock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() { return current(); }
+    static void set(time_point t) { current() = t; }
+    static void advance(duration d) { current() += d; }
+
+private:
+    static time_point &current()
+    {
+        static thread_local time_point t;
+        return t;
+    }
+};
+
+// Approximate malloc footprint of an n-byte request (glibc: 8-byte header,
+// 16-byte granularity).
+inline size_t malloc_footprint(size_t n) { return n == 0 ? 0 : ((n + 8 + 15) & ~size_t(15)); }
+
+// Heap bytes owned by a key/value beyond its sizeof. Overload for new types.
+template <class T>
+size_t cache_heap_bytes(const T &) { return 0; }
+
+inline size_t cache_heap_bytes(const std::string &s)
+{
+    // Short strings live inside the object (SSO) and own no heap block
+    const char *p = s.data();
+    const char *self = reinterpret_cast<const char *>(&s);
+    if (p >= self && p < self + sizeof(s))
+        return 0;
+    return malloc_footprint(s.capacity() + 1);
+}
+
+template <class T>
+size_t cache_heap_bytes(const std::vector<T> &v)
+{
+    size_t n = malloc_footprint(v.capacity() * sizeof(T));
+    for (const auto &e : v)
+        n += cache_heap_bytes(e);
+    return n;
+}
+
+// Count-min sketch of saturating 4-bit counters (stored one per byte) used as
+// the TinyLFU popularity estimate. Every `10 * capacity` increments all
+// counters are halved so stale popularity fades out.
+class FrequencySketch
+{
+public:
+    explicit FrequencySketch(size_t capacity)
+    {
+        size_t width = 16;
+        while (width < capacity)
+            width <<= 1;
+        mask_ = width - 1;
+        table_.assign(width * DEPTH, 0);
+        sample_limit_ = std::max<size_t>(10 * capacity, 16);
+    }
+
+    void record(size_t hash)
+    {
+        bool added = false;
+        for (size_t row = 0; row < DEPTH; ++row)
+        {
+            uint8_t &c = table_[row * (mask_ + 1) + index(hash, row)];
+            if (c < MAX_COUNT)
+            {
+                ++c;
+                added = true;
+            }
+        }
+        if (added && ++samples_ >= sample_limit_)
+            age();
+    }
+
+    uint8_t estimate(size_t hash) const
+    {
+        uint8_t est = MAX_COUNT;
+        for (size_t row = 0; row < DEPTH; ++row)
+            est = std::min(est, table_[row * (mask_ + 1) + index(hash, row)]);
+        return est;
+    }
+
+private:
+    static constexpr size_t DEPTH = 4;
+    static constexpr uint8_t MAX_COUNT = 15;
+
+    size_t index(size_t hash, size_t row) const
+    {
+        static constexpr uint64_t SEEDS[DEPTH] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+                                                  0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL};
+        uint64_t x = (static_cast<uint64_t>(hash) ^ SEEDS[row]) * 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 31;
+        return static_cast<size_t>(x) & mask_;
+    }
+
+    void age()
+    {
+        for (auto &c : table_)
+            c >>= 1;
+        samples_ /= 2;
+    }
+
+    std::vector<uint8_t> table_;
+    size_t mask_ = 0;
+    size_t samples_ = 0;
+    size_t sample_limit_ = 0;
+};
+
+// `Clock` supplies now() for expiry; ManualClock drives it from a trace.
+template <class K, class V, class Clock = std::chrono::steady_clock>
 class LruTtlCache
 {
-    using Clock = std::chrono::steady_clock;
 
     struct Entry
     {
         K key;
         V value;
-        Clock::time_point expires_at;
+        typename Clock::time_point expires_at;
+        bool in_window = false;
+        size_t charge = 0; // bytes attributed to this entry
     };
+    using List = std::list<Entry>;
+    using Map = std::unordered_map<K, typename List::iterator>;
+
+    // Sizes the frequency sketch when capacity is given in bytes
+    static constexpr size_t BYTES_PER_ENTRY_HINT = 256;
 
 public:
-    explicit LruTtlCache(size_t capacity) : cap_(capacity) {}
+    // `capacity` is an entry count or a byte budget depending on `limit`.
+    // In byte mode every entry is charged for its list node, hash-map node,
+    // bucket slot, both key copies and the value's heap blocks, and eviction
+    // runs until the total fits.
+    //
+    // With CachePolicy::WTinyLfu ~1% of the capacity is an admission window;
+    // entries leaving it only displace the main LRU tail when the sketch says
+    // they are more popular, so a scan of one-off names cannot flush
+    // the hot set.
+    explicit LruTtlCache(size_t capacity, CachePolicy policy = CachePolicy::Lru,
+                         CacheLimit limit = CacheLimit::Entries)
+        : cap_(capacity), policy_(policy), limit_(limit),
+          window_cap_(policy == CachePolicy::WTinyLfu ? std::max<size_t>(1, capacity / 100) : 0),
+          main_cap_(capacity - window_cap_),
+          sketch_(policy != CachePolicy::WTinyLfu ? 0
+                  : limit == CacheLimit::Bytes    ? capacity / BYTES_PER_ENTRY_HINT
+                                                  : capacity) {}
 
-    // Return true on hit. Fills out and ttl_left_sec.
-    bool get(const K &key, V &out, uint32_t &ttl_left_sec)
+    // Return true on hit. Fills out and ttl_left_sec. A `probe` for a key
+    // that is usually absent (the CNAME check after an address miss) does
+    // not count an absent key as a miss or as an access for admission.
+    bool get(const K &key, V &out, uint32_t &ttl_left_sec, bool probe = false)
     {
         auto it = map_.find(key);
+        if (probe && it == map_.end())
+            return false;
+        if (policy_ == CachePolicy::WTinyLfu)
+            sketch_.record(hasher_(key));
+
         if (it == map_.end())
         {
             misses_++;
@@ -29,70 +201,194 @@ public:
         }
 
         auto node_it = it->second;
+        List &list = list_of(*node_it);
         auto now = Clock::now();
         if (now >= node_it->expires_at)
         {
-            items_.erase(node_it);
-            map_.erase(it);
+            erase_node(list, node_it);
             misses_++;
             return false;
         }
 
-        items_.splice(items_.begin(), items_, node_it); // MRU
-        out = items_.front().value;
+        list.splice(list.begin(), list, node_it); // MRU
+        out = node_it->value;
         ttl_left_sec = static_cast<uint32_t>(
-            std::chrono::duration_cast<std::chrono::seconds>(items_.front().expires_at - now).count());
+            std::chrono::duration_cast<std::chrono::seconds>(node_it->expires_at - now).count());
         hits_++;
         return true;
     }
 
-    void put(const K &key, const V &val, uint32_t ttl_sec)
+    // Taken by value so callers can move keys/values in (bulk loads).
+    CachePut put(K key, V val, uint32_t ttl_sec)
     {
         auto exp = Clock::now() + std::chrono::seconds(ttl_sec);
         auto it = map_.find(key);
 
         if (it != map_.end())
         {
-            it->second->value = val;
-            it->second->expires_at = exp;
-            items_.splice(items_.begin(), items_, it->second);
-            return;
+            auto node_it = it->second;
+            List &list = list_of(*node_it);
+            size_t old_weight = weight_of(*node_it);
+            bytes_used_ -= node_it->charge;
+            bool same = node_it->value == val;
+            node_it->value = std::move(val);
+            node_it->expires_at = exp;
+            node_it->charge = charge_of(node_it->key, node_it->value);
+            bytes_used_ += node_it->charge;
+            weight_of_list(list) += weight_of(*node_it) - old_weight;
+            peak_bytes_ = std::max(peak_bytes_, bytes_used_);
+            list.splice(list.begin(), list, node_it);
+            enforce_limits();
+            return same ? CachePut::Refreshed : CachePut::Replaced;
         }
 
-        if (items_.size() == cap_)
+        size_t charge = charge_of(key, val);
+        size_t weight = (limit_ == CacheLimit::Bytes) ? charge : 1;
+        if (weight > cap_)
+            return CachePut::Rejected; // would never fit
+
+        bool windowed = (policy_ == CachePolicy::WTinyLfu);
+        List &list = windowed ? window_ : items_;
+        list.push_front(Entry{std::move(key), std::move(val), exp, windowed, charge});
+        map_[list.front().key] = list.begin();
+        weight_of_list(list) += weight;
+        bytes_used_ += charge;
+        peak_bytes_ = std::max(peak_bytes_, bytes_used_);
+        enforce_limits();
+        return CachePut::Inserted;
+    }
+
+    // Visits unexpired entries from LRU to MRU as fn(key, value, time_left).
+    // Re-inserting in this order with put() reproduces the recency order.
+    template <class Fn>
+    void for_each_lru_to_mru(Fn &&fn) const
+    {
+        auto now = Clock::now();
+        for (const List *list : {&items_, &window_})
         {
-            auto &last = items_.back();
-            map_.erase(last.key);
-            items_.pop_back();
+            for (auto it = list->rbegin(); it != list->rend(); ++it)
+            {
+                if (now >= it->expires_at)
+                    continue;
+                fn(it->key, it->value, it->expires_at - now);
+            }
         }
-        items_.push_front(Entry{key, val, exp});
-        map_[key] = items_.begin();
     }
 
+    void reserve(size_t n) { map_.reserve(limit_ == CacheLimit::Entries ? std::min(n, cap_) : n); }
+
     void purge_expired()
     {
         auto now = Clock::now();
-        for (auto it = items_.begin(); it != items_.end();)
+        for (List *list : {&items_, &window_})
         {
-            if (now >= it->expires_at)
+            for (auto it = list->begin(); it != list->end();)
             {
-                map_.erase(it->key);
-                it = items_.erase(it);
-            }
-            else
-            {
-                ++it;
+                if (now >= it->expires_at)
+                    it = erase_node(*list, it);
+                else
+                    ++it;
             }
         }
     }
 
     size_t hits() const { return hits_; }
     size_t misses() const { return misses_; }
-    size_t size() const { return items_.size(); }
+    size_t size() const { return items_.size() + window_.size(); }
+    size_t capacity() const { return cap_; }
+    CachePolicy policy() const { return policy_; }
+    CacheLimit limit() const { return limit_; }
+    // Charged bytes of all entries (plus the bucket array) and the high-water mark
+    size_t bytes_used() const { return bytes_used_ + map_.bucket_count() * sizeof(void *); }
+    size_t peak_bytes() const { return std::max(peak_bytes_ + map_.bucket_count() * sizeof(void *), bytes_used()); }
 
 private:
+    static size_t charge_of(const K &key, const V &val)
+    {
+        // list node: Entry + prev/next; map node: next + value + cached hash
+        constexpr size_t LIST_NODE = sizeof(Entry) + 2 * sizeof(void *);
+        constexpr size_t MAP_NODE = sizeof(void *) + sizeof(typename Map::value_type) + sizeof(size_t);
+        return malloc_footprint(LIST_NODE) + malloc_footprint(MAP_NODE) +
+               2 * cache_heap_bytes(key) + cache_heap_bytes(val);
+    }
+
+    size_t weight_of(const Entry &e) const { return limit_ == CacheLimit::Bytes ? e.charge : 1; }
+    List &list_of(const Entry &e) { return e.in_window ? window_ : items_; }
+    size_t &weight_of_list(const List &list) { return &list == &window_ ? window_weight_ : main_weight_; }
+
+    // In byte mode the hash table's bucket array is paid for by the main LRU
+    size_t main_budget() const
+    {
+        if (limit_ != CacheLimit::Bytes)
+            return main_cap_;
+        size_t buckets = map_.bucket_count() * sizeof(void *);
+        return main_cap_ > buckets ? main_cap_ - buckets : 0;
+    }
+
+    typename List::iterator erase_node(List &list, typename List::iterator it)
+    {
+        weight_of_list(list) -= weight_of(*it);
+        bytes_used_ -= it->charge;
+        map_.erase(it->key);
+        return list.erase(it);
+    }
+
+    void enforce_limits()
+    {
+        while (window_weight_ > window_cap_ && !window_.empty())
+            evict_from_window();
+        // An update can grow an entry past the budget; keep it (it is at the front)
+        while (main_weight_ > main_budget() && items_.size() > 1)
+            erase_node(items_, std::prev(items_.end()));
+    }
+
+    // Window overflowed: its LRU entry either enters the main LRU (free room,
+    // expired victims, or more popular than each victim it displaces) or is
+    // dropped.
+    void evict_from_window()
+    {
+        auto cand = std::prev(window_.end());
+        size_t cand_weight = weight_of(*cand);
+        if (cand_weight > main_cap_)
+        {
+            erase_node(window_, cand);
+            return;
+        }
+
+        auto now = Clock::now();
+        uint8_t cand_freq = sketch_.estimate(hasher_(cand->key));
+        while (main_weight_ + cand_weight > main_budget() && !items_.empty())
+        {
+            // Neither key ever looked up (e.g. snapshot restore): fall back to recency
+            auto victim = std::prev(items_.end());
+            uint8_t victim_freq = sketch_.estimate(hasher_(victim->key));
+            bool admit = now >= victim->expires_at || cand_freq > victim_freq ||
+                         (cand_freq == 0 && victim_freq == 0);
+            if (!admit)
+            {
+                erase_node(window_, cand);
+                return;
+            }
+            erase_node(items_, victim);
+        }
+
+        window_weight_ -= cand_weight;
+        main_weight_ += cand_weight;
+        cand->in_window = false;
+        items_.splice(items_.begin(), window_, cand);
+    }
+
     size_t cap_;
-    std::list<Entry> items_;
-    std::unordered_map<K, typename std::list<Entry>::iterator> map_;
+    CachePolicy policy_;
+    CacheLimit limit_;
+    size_t window_cap_;
+    size_t main_cap_;
+    List items_;  // main LRU (the only list under CachePolicy::Lru)
+    List window_; // W-TinyLFU admission window
+    size_t main_weight_{0}, window_weight_{0};
+    Map map_;
+    FrequencySketch sketch_;
+    std::hash<K> hasher_;
     size_t hits_{0}, misses_{0};
+    size_t bytes_used_{0}, peak_bytes_{0};
 };
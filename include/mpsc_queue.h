@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+// Unbounded multi-producer, single-consumer queue (Vyukov's intrusive node
+// queue). push() is one allocation and one atomic exchange, with no lock and
+// no retry loop, so producers never wait on each other or on the consumer.
+// pop() must only be called from one thread at a time.
+//
+// A push that has swapped the head but not yet linked its node is invisible
+// to pop() for that moment; callers that signal the consumer after push()
+// (eventfd, condition variable) see the item on the wakeup that follows.
+template <class T>
+class MpscQueue
+{
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        T value;
+    };
+
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+    ~MpscQueue()
+    {
+        T drop;
+        while (pop(drop))
+        {
+        }
+        if (tail_ != &stub_)
+            delete tail_;
+    }
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void push(T value)
+    {
+        Node *n = new Node;
+        n->value = std::move(value);
+        Node *prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    bool pop(T &out)
+    {
+        Node *tail = tail_;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        out = std::move(next->value); // `next` becomes the new (empty) stub
+        tail_ = next;
+        if (tail != &stub_)
+            delete tail;
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<Node *> head_; // producers
+    alignas(64) Node *tail_;               // consumer
+    Node stub_;
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per-hop timing of upstream resolutions.
+//
+// While a ResolveTrace is installed on a thread, resolve_with_ttl() and
+// resolve_dual_stack_with_ttl() record one span for every resolution step
+// they take there: the resolution itself, each query sent (server, question,
+// send and receive time, RCODE, reply size, what the reply said), each CNAME
+// target chased and each nameserver looked up because a referral came
+// without glue. Spans nest: a step's children ran inside it.
+
+enum class SpanKind
+{
+    Resolve,  // a resolution started by the caller
+    Query,    // one query to one server
+    Cname,    // resolution of a CNAME target
+    NsLookup, // address of a nameserver that came without glue
+};
+
+struct TraceSpan
+{
+    SpanKind kind = SpanKind::Resolve;
+    int depth = 0;
+    int lane = 0; // queries in flight at once get their own lane
+    std::string name;
+    uint16_t qtype = 0; // 0: A and AAAA together
+    std::string server; // Query: "ip:port"
+    int64_t start_us = 0; // since the trace started; a query's send time
+    int64_t end_us = -1;  // a query's receive (or give-up) time
+    int rcode = -1;       // Query: -1 = no reply
+    size_t bytes = 0;     // Query: reply size
+    std::string detail;   // outcome, e.g. "referral to com (13 NS, 13 with glue)"
+};
+
+class ResolveTrace
+{
+public:
+    ResolveTrace();
+
+    // Spans are kept in start order. Resolve/Cname/NsLookup spans enclose
+    // the spans begun before they end; queries enclose nothing.
+    size_t begin(SpanKind kind, const std::string &name, uint16_t qtype, const std::string &server = "");
+    void end(size_t span);
+    TraceSpan &span(size_t i) { return spans_[i]; }
+
+    const std::vector<TraceSpan> &spans() const { return spans_; }
+
+    // Indented waterfall of the spans from `first` on, with µs offsets,
+    // durations and a bar scaled to the slowest top-level span
+    void print_waterfall(std::ostream &os, size_t first = 0) const;
+
+    // Chrome trace-event JSON ("X" events; open in chrome://tracing or Perfetto)
+    bool write_chrome_json(const std::string &path) const;
+
+private:
+    int64_t now_us() const;
+
+    std::vector<TraceSpan> spans_;
+    std::vector<size_t> open_;  // enclosing spans, innermost last
+    int queries_in_flight_ = 0;
+    const std::chrono::steady_clock::time_point start_;
+};
+
+// Installs `trace` for resolutions on the calling thread; nullptr turns
+// tracing off (the default)
+void set_resolve_trace(ResolveTrace *trace);
+ResolveTrace *current_resolve_trace();
@@ -3,15 +3,40 @@
 #include <vector>
 #include <cstdint>
 
+// `owner` is an alias (CNAME) for `target`; names are lowercase
+struct CnameLink
+{
+    std::string owner;
+    std::string target;
+    uint32_t ttl = 0;
+};
+
 struct DnsResult
 {
     std::vector<std::string> answers;
-    uint32_t min_ttl = 0;
+    uint32_t min_ttl = 0; // shortest TTL across the answers and the CNAME chain
     bool nxdomain = false;
+    std::vector<CnameLink> chain; // aliases from the queried name to the answers' owner
+    uint32_t answer_ttl = 0;      // TTL of the answers' own RRset
+    bool nodata = false;          // NOERROR without records of this type: the name exists
 };
 
+// Replaces the first-hop servers (default: the public resolvers in
+// resolver.cpp); an empty list restores them. Call before any lookup.
+void set_upstream_servers(const std::vector<std::string> &ips, uint16_t port = 53);
+
 // Legacy API (strings only)
 std::vector<std::string> resolve(const std::string &domain, uint16_t qtype);
 
 // TTL-aware API used by the cached CLI
 DnsResult resolve_with_ttl(const std::string &domain, uint16_t qtype);
+
+struct DualStackResult
+{
+    DnsResult a;
+    DnsResult aaaa;
+};
+
+// A and AAAA together: both queries are in flight at once, so the pair costs
+// about one upstream RTT instead of two.
+DualStackResult resolve_dual_stack_with_ttl(const std::string &domain);
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Answer cache living in a POSIX shared-memory segment, so every resolver
+// process on the host reads and fills the same cache and a restart keeps it.
+//
+// The segment is a header followed by a fixed array of buckets; each bucket
+// holds SHM_CACHE_WAYS fixed-size slots and a seqlock. Nothing inside the
+// segment is a pointer. Writers take the bucket by making its sequence odd;
+// readers copy the slot and retry if the sequence moved, so they never block.
+// Expiry is stored as absolute wall-clock seconds, valid across processes.
+//
+// A writer records its pid with the odd sequence, so a bucket left locked by
+// a process that died mid-write is cleared by the next writer to find it.
+// Processes sharing a segment must share a PID namespace.
+
+constexpr uint64_t SHM_CACHE_MAGIC = 0x31484341434e5344ULL; // "DNSCACH1"
+constexpr uint32_t SHM_CACHE_VERSION = 2;
+constexpr size_t SHM_CACHE_WAYS = 4;
+constexpr size_t SHM_CACHE_SLOT_BYTES = 1024;
+constexpr size_t SHM_CACHE_KEY_MAX = 264;
+constexpr size_t SHM_CACHE_VALUE_MAX = SHM_CACHE_SLOT_BYTES - SHM_CACHE_KEY_MAX - 24;
+
+struct ShmCacheSlot
+{
+    uint64_t key_hash; // 0 = empty
+    int64_t expires_at;
+    uint16_t key_len;
+    uint16_t value_len;
+    uint16_t answer_count;
+    uint16_t reserved;
+    char key[SHM_CACHE_KEY_MAX];
+    uint8_t value[SHM_CACHE_VALUE_MAX]; // answers as [u8 len][bytes]...
+};
+static_assert(sizeof(ShmCacheSlot) == SHM_CACHE_SLOT_BYTES, "slot layout");
+
+struct ShmCacheBucket
+{
+    // Low 32 bits: sequence, odd while a writer owns the bucket; high 32
+    // bits: that writer's pid. One word, so owner and sequence change together.
+    std::atomic<uint64_t> lock;
+    ShmCacheSlot slots[SHM_CACHE_WAYS];
+};
+
+struct alignas(64) ShmCacheHeader
+{
+    std::atomic<uint64_t> magic; // published last by the creator
+    uint32_t version;
+    uint32_t bucket_count;
+    uint32_t ways;
+    uint32_t slot_bytes;
+};
+
+class ShmDnsCache
+{
+public:
+    ShmDnsCache() = default;
+    ~ShmDnsCache();
+    ShmDnsCache(const ShmDnsCache &) = delete;
+    ShmDnsCache &operator=(const ShmDnsCache &) = delete;
+
+    // Attaches to segment `name` (e.g. "/dns_resolver"), creating it with
+    // `bucket_count` buckets if it does not exist yet, or was left half-built
+    // by a creator that died. Returns false on error.
+    bool open(const std::string &name, uint32_t bucket_count);
+
+    bool attached() const { return hdr_ != nullptr; }
+
+    // Same contract as LruTtlCache::get / put.
+    bool get(const std::string &key, std::vector<std::string> &out, uint32_t &ttl_left_sec);
+    void put(const std::string &key, const std::vector<std::string> &val, uint32_t ttl_sec);
+
+    // Removes the segment name; attached processes keep their mapping.
+    static bool unlink(const std::string &name);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t capacity() const { return hdr_ ? size_t(hdr_->bucket_count) * SHM_CACHE_WAYS : 0; }
+
+private:
+    ShmCacheHeader *hdr_ = nullptr;
+    ShmCacheBucket *buckets_ = nullptr;
+    size_t len_ = 0;
+    size_t hits_{0}, misses_{0};
+
+    bool lock_bucket(ShmCacheBucket &b, uint32_t &seq);
+};
@@ -0,0 +1,373 @@
+#include "blocklist.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline uint8_t lower(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+// ---- reader ----------------------------------------------------------------
+
+Blocklist::~Blocklist()
+{
+    if (base_)
+        munmap(const_cast<uint8_t *>(base_), len_);
+}
+
+bool Blocklist::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot open blocklist " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(BlocklistImageHeader))
+    {
+        std::cerr << "Blocklist " << path << " is truncated.\n";
+        ::close(fd);
+        return false;
+    }
+
+    size_t len = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Cannot mmap blocklist " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    const auto *hdr = static_cast<const BlocklistImageHeader *>(map);
+    bool ok = std::memcmp(hdr->magic, BLOCKLIST_IMAGE_MAGIC, sizeof(hdr->magic)) == 0 &&
+              hdr->version == BLOCKLIST_IMAGE_VERSION &&
+              hdr->file_size == len &&
+              hdr->node_count > 0 &&
+              hdr->nodes_off <= hdr->pool_off &&
+              hdr->nodes_off + uint64_t(hdr->node_count) * sizeof(BlockNode) <= hdr->pool_off &&
+              hdr->pool_off <= len;
+    if (!ok)
+    {
+        std::cerr << "Blocklist " << path << " has a bad header or version.\n";
+        munmap(map, len);
+        return false;
+    }
+
+    base_ = static_cast<const uint8_t *>(map);
+    len_ = len;
+    hdr_ = hdr;
+    nodes_ = reinterpret_cast<const BlockNode *>(base_ + hdr->nodes_off);
+    pool_ = base_ + hdr->pool_off;
+    return true;
+}
+
+// Byte-wise compare of a stored (lower-case) label with a query label.
+static int compare_label(const uint8_t *stored, size_t stored_len, std::string_view label)
+{
+    size_t n = std::min(stored_len, label.size());
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint8_t a = stored[i];
+        uint8_t b = lower(static_cast<uint8_t>(label[i]));
+        if (a != b)
+            return a < b ? -1 : 1;
+    }
+    if (stored_len == label.size())
+        return 0;
+    return stored_len < label.size() ? -1 : 1;
+}
+
+bool Blocklist::blocked(std::string_view name) const
+{
+    if (!hdr_)
+        return false;
+    if (!name.empty() && name.back() == '.')
+        name.remove_suffix(1);
+
+    // Node fields come from the file: every child range and label is
+    // checked on the way down, so a corrupt image just stops matching
+    // (open() only reads the header, keeping startup instant)
+    const size_t pool_len = len_ - hdr_->pool_off;
+    const BlockNode *node = &nodes_[0];
+    size_t end = name.size();
+    while (end > 0)
+    {
+        size_t dot = name.rfind('.', end - 1);
+        size_t start = (dot == std::string_view::npos) ? 0 : dot + 1;
+        std::string_view label = name.substr(start, end - start);
+
+        if (uint64_t(node->first_child) + node->child_count > hdr_->node_count)
+            return false;
+        uint32_t lo = node->first_child;
+        uint32_t hi = lo + node->child_count;
+        const BlockNode *next = nullptr;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (uint64_t(nodes_[mid].label_off) + nodes_[mid].label_len > pool_len)
+                return false;
+            int c = compare_label(pool_ + nodes_[mid].label_off, nodes_[mid].label_len, label);
+            if (c < 0)
+                lo = mid + 1;
+            else if (c > 0)
+                hi = mid;
+            else
+            {
+                next = &nodes_[mid];
+                break;
+            }
+        }
+
+        if (!next)
+            return false;
+        if (next->blocked)
+            return true;
+        if (dot == std::string_view::npos)
+            break;
+        node = next;
+        end = dot;
+    }
+    return false;
+}
+
+bool BlocklistHandle::reload(const std::string &path)
+{
+    auto fresh = std::make_shared<Blocklist>();
+    if (!fresh->open(path))
+        return false; // keep serving the previous list
+    std::atomic_store(&active_, std::shared_ptr<const Blocklist>(std::move(fresh)));
+    return true;
+}
+
+std::shared_ptr<const Blocklist> BlocklistHandle::current() const
+{
+    return std::atomic_load(&active_);
+}
+
+// ---- source parsing --------------------------------------------------------
+
+static bool is_ip(const std::string &s)
+{
+    uint8_t buf[16];
+    return inet_pton(AF_INET, s.c_str(), buf) == 1 || inet_pton(AF_INET6, s.c_str(), buf) == 1;
+}
+
+bool parse_blocklist_source(const std::string &path, std::vector<std::string> &out)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Cannot read " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line[0] == '!')
+            continue; // adblock comment
+        size_t cut = line.find('#');
+        if (cut != std::string::npos)
+            line.erase(cut);
+
+        std::istringstream ss(line);
+        std::string first, second;
+        if (!(ss >> first))
+            continue;
+
+        std::string domain = first;
+        if (is_ip(first))
+        {
+            // hosts-style sinkhole list
+            if (!(ss >> second))
+                continue;
+            domain = second;
+        }
+        else if (domain.compare(0, 2, "||") == 0)
+        {
+            domain.erase(0, 2);
+            size_t caret = domain.find('^');
+            if (caret == std::string::npos)
+                continue; // not a plain domain rule
+            domain.erase(caret);
+        }
+
+        if (domain == "localhost" || domain == "localhost.localdomain" ||
+            domain == "broadcasthost" || domain == "local" || domain == "0.0.0.0")
+            continue;
+        if (domain.find_first_of("*/:") != std::string::npos)
+            continue;
+
+        out.push_back(std::move(domain));
+    }
+    return true;
+}
+
+// ---- compiler --------------------------------------------------------------
+
+namespace
+{
+struct TmpNode
+{
+    uint32_t label_id;
+    bool blocked;
+    std::vector<uint32_t> children;
+};
+} // namespace
+
+bool compile_blocklist_image(const std::vector<std::string> &domains, const std::string &out_path)
+{
+    std::vector<std::string> labels;                   // id -> label
+    std::unordered_map<std::string, uint32_t> label_id; // label -> id
+    std::unordered_map<uint64_t, uint32_t> edges;       // (parent << 32 | label id) -> child
+    std::vector<TmpNode> tmp;
+    tmp.push_back(TmpNode{0, false, {}});
+    labels.emplace_back(); // root label
+
+    std::string label;
+    for (const std::string &raw : domains)
+    {
+        std::string_view name = raw;
+        if (!name.empty() && name.back() == '.')
+            name.remove_suffix(1);
+        if (name.empty() || name.size() > 253)
+            continue;
+
+        uint32_t node = 0;
+        bool covered = false;
+        size_t end = name.size();
+        while (true)
+        {
+            size_t dot = name.rfind('.', end - 1);
+            size_t start = (dot == std::string_view::npos) ? 0 : dot + 1;
+            if (end == start || end - start > 63)
+            {
+                covered = true; // malformed; skip the entry
+                break;
+            }
+            label.assign(name.substr(start, end - start));
+            for (char &c : label)
+                c = static_cast<char>(lower(static_cast<uint8_t>(c)));
+
+            auto lit = label_id.find(label);
+            uint32_t lid;
+            if (lit == label_id.end())
+            {
+                lid = static_cast<uint32_t>(labels.size());
+                label_id.emplace(label, lid);
+                labels.push_back(label);
+            }
+            else
+                lid = lit->second;
+
+            uint64_t key = (uint64_t(node) << 32) | lid;
+            auto eit = edges.find(key);
+            uint32_t child;
+            if (eit == edges.end())
+            {
+                child = static_cast<uint32_t>(tmp.size());
+                tmp.push_back(TmpNode{lid, false, {}});
+                tmp[node].children.push_back(child);
+                edges.emplace(key, child);
+            }
+            else
+                child = eit->second;
+
+            node = child;
+            if (tmp[node].blocked)
+            {
+                covered = true; // a parent is already blocked
+                break;
+            }
+            if (dot == std::string_view::npos)
+                break;
+            end = dot;
+        }
+        if (!covered)
+            tmp[node].blocked = true;
+    }
+    edges.clear();
+    label_id.clear();
+
+    // Label pool; offsets by label id.
+    std::vector<uint8_t> pool;
+    std::vector<uint32_t> label_off(labels.size());
+    for (size_t i = 0; i < labels.size(); ++i)
+    {
+        label_off[i] = static_cast<uint32_t>(pool.size());
+        pool.insert(pool.end(), labels[i].begin(), labels[i].end());
+    }
+
+    // BFS layout: every node's children contiguous and sorted by label; blocked
+    // nodes keep no children since they already cover their subtree.
+    std::vector<BlockNode> nodes;
+    std::vector<uint32_t> queue{0};
+    nodes.push_back(BlockNode{0, 0, 0, 0, 0, 0});
+    uint64_t domain_count = 0;
+    for (size_t qi = 0; qi < queue.size(); ++qi)
+    {
+        TmpNode &t = tmp[queue[qi]];
+        BlockNode &out = nodes[qi];
+        if (t.blocked)
+        {
+            ++domain_count;
+            continue;
+        }
+
+        std::sort(t.children.begin(), t.children.end(), [&](uint32_t a, uint32_t b)
+                  { return labels[tmp[a].label_id] < labels[tmp[b].label_id]; });
+        out.first_child = static_cast<uint32_t>(nodes.size());
+        out.child_count = static_cast<uint32_t>(t.children.size());
+        for (uint32_t c : t.children)
+        {
+            const TmpNode &ct = tmp[c];
+            nodes.push_back(BlockNode{label_off[ct.label_id],
+                                      static_cast<uint8_t>(labels[ct.label_id].size()),
+                                      static_cast<uint8_t>(ct.blocked ? 1 : 0), 0, 0, 0});
+            queue.push_back(c);
+        }
+    }
+
+    BlocklistImageHeader hdr{};
+    std::memcpy(hdr.magic, BLOCKLIST_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = BLOCKLIST_IMAGE_VERSION;
+    hdr.node_count = static_cast<uint32_t>(nodes.size());
+    hdr.domain_count = domain_count;
+    hdr.nodes_off = sizeof(BlocklistImageHeader);
+    hdr.pool_off = hdr.nodes_off + uint64_t(nodes.size()) * sizeof(BlockNode);
+    hdr.file_size = hdr.pool_off + pool.size();
+
+    // Temp file + rename: a reloading resolver only ever maps complete images.
+    std::string tmp_path = out_path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Cannot write " << tmp_path << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(BlockNode));
+    out.write(reinterpret_cast<const char *>(pool.data()), pool.size());
+    out.close();
+    if (!out || std::rename(tmp_path.c_str(), out_path.c_str()) != 0)
+    {
+        std::cerr << "Failed to write blocklist " << out_path << "\n";
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
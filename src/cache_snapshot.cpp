@@ -0,0 +1,179 @@
+#include "cache_snapshot.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int64_t wall_now()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+template <class T>
+static void append_pod(std::vector<uint8_t> &buf, const T &v)
+{
+    const auto *p = reinterpret_cast<const uint8_t *>(&v);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+bool save_cache_snapshot(const DnsAnswerCache &cache, const std::string &path)
+{
+    const int64_t now = wall_now();
+
+    std::vector<uint8_t> buf;
+    buf.reserve(sizeof(CacheSnapshotHeader) + cache.size() * 64);
+    buf.resize(sizeof(CacheSnapshotHeader));
+
+    uint64_t count = 0;
+    cache.for_each_lru_to_mru([&](const std::string &key, const std::vector<std::string> &answers,
+                                  std::chrono::steady_clock::duration left)
+                              {
+        if (key.size() > UINT16_MAX || answers.size() > UINT16_MAX)
+            return;
+        // Truncated: a restored entry may expire up to a second early, never late
+        int64_t expires_at = now + std::chrono::duration_cast<std::chrono::seconds>(left).count();
+        append_pod(buf, expires_at);
+        append_pod(buf, static_cast<uint16_t>(key.size()));
+        buf.insert(buf.end(), key.begin(), key.end());
+        append_pod(buf, static_cast<uint16_t>(answers.size()));
+        for (const auto &a : answers)
+        {
+            uint16_t len = static_cast<uint16_t>(std::min<size_t>(a.size(), UINT16_MAX));
+            append_pod(buf, len);
+            buf.insert(buf.end(), a.begin(), a.begin() + len);
+        }
+        ++count; });
+
+    CacheSnapshotHeader hdr{};
+    std::memcpy(hdr.magic, CACHE_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = CACHE_SNAPSHOT_VERSION;
+    hdr.entry_count = count;
+    hdr.created_at = now;
+    std::memcpy(buf.data(), &hdr, sizeof(hdr));
+
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Cannot write cache snapshot " << tmp << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+    out.close();
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Failed to write cache snapshot " << path << "\n";
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_cache_snapshot(DnsAnswerCache &cache, const std::string &path, size_t *loaded)
+{
+    if (loaded)
+        *loaded = 0;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return errno == ENOENT; // first start: nothing to warm from
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(CacheSnapshotHeader))
+    {
+        std::cerr << "Cache snapshot " << path << " is truncated, ignoring.\n";
+        ::close(fd);
+        return false;
+    }
+
+    size_t len = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Cannot mmap cache snapshot " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    const uint8_t *base = static_cast<const uint8_t *>(map);
+    CacheSnapshotHeader hdr;
+    std::memcpy(&hdr, base, sizeof(hdr));
+    if (std::memcmp(hdr.magic, CACHE_SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != CACHE_SNAPSHOT_VERSION)
+    {
+        std::cerr << "Cache snapshot " << path << " has an unknown format, ignoring.\n";
+        munmap(map, len);
+        return false;
+    }
+
+    const int64_t now = wall_now();
+    const uint8_t *p = base + sizeof(hdr);
+    const uint8_t *end = base + len;
+    auto take = [&](void *dst, size_t n)
+    {
+        if (static_cast<size_t>(end - p) < n)
+            return false;
+        std::memcpy(dst, p, n);
+        p += n;
+        return true;
+    };
+
+    cache.reserve(static_cast<size_t>(hdr.entry_count));
+    size_t inserted = 0;
+    bool ok = true;
+    for (uint64_t i = 0; i < hdr.entry_count && ok; ++i)
+    {
+        int64_t expires_at;
+        uint16_t key_len, answer_count;
+        ok = take(&expires_at, sizeof(expires_at)) && take(&key_len, sizeof(key_len)) &&
+             static_cast<size_t>(end - p) >= key_len;
+        if (!ok)
+            break;
+        const char *key = reinterpret_cast<const char *>(p);
+        p += key_len;
+        if (!take(&answer_count, sizeof(answer_count)))
+        {
+            ok = false;
+            break;
+        }
+
+        bool live = expires_at > now;
+        std::vector<std::string> answers;
+        if (live)
+            answers.reserve(answer_count);
+        for (uint16_t a = 0; a < answer_count; ++a)
+        {
+            uint16_t alen;
+            if (!take(&alen, sizeof(alen)) || static_cast<size_t>(end - p) < alen)
+            {
+                ok = false;
+                break;
+            }
+            if (live)
+                answers.emplace_back(reinterpret_cast<const char *>(p), alen);
+            p += alen;
+        }
+
+        if (ok && live)
+        {
+            if (cache.put(std::string(key, key_len), std::move(answers),
+                          static_cast<uint32_t>(expires_at - now)) != CachePut::Rejected)
+                ++inserted;
+        }
+    }
+    munmap(map, len);
+
+    if (!ok)
+        std::cerr << "Cache snapshot " << path << " is truncated; loaded " << inserted << " entries.\n";
+    if (loaded)
+        *loaded = inserted;
+    return ok;
+}
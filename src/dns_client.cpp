@@ -1,6 +1,11 @@
 #include "dns_client.h"
+#include "dns_transport.h"
+#include "dns_dot.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <cstring>
+#include <poll.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -9,8 +14,21 @@
 
 constexpr size_t MAX_DNS_RESPONSE = 512;
 
-int send_query(std::vector<uint8_t> &packet, const std::string &server_ip, uint16_t port)
+static int send_packet(const uint8_t *data, size_t len, const char *server_ip, uint16_t port)
 {
+    TransportMode mode = transport_mode();
+    if (mode == TransportMode::Replay)
+        return transport_replay_send(data, len, server_ip, port);
+
+    if (dot_enabled())
+    {
+        // Captures keep the logical upstream (ip:53), so they replay without TLS
+        int handle = dot_send(data, len, server_ip);
+        if (handle >= 0 && mode == TransportMode::Record)
+            transport_record_send(handle, data, len, server_ip, port);
+        return handle;
+    }
+
     int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
 
     if (sockfd < 0)
@@ -24,14 +42,14 @@ int send_query(std::vector<uint8_t> &packet, const std::string &server_ip, uint1
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(port);
 
-    if (inet_pton(AF_INET, server_ip.c_str(), &server_addr.sin_addr) <= 0)
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0)
     {
         std::cerr << " Invalid server IP address.\n";
         close(sockfd);
         return -1;
     }
 
-    ssize_t sent = sendto(sockfd, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr *>(&server_addr), sizeof(server_addr));
+    ssize_t sent = sendto(sockfd, data, len, 0, reinterpret_cast<sockaddr *>(&server_addr), sizeof(server_addr));
 
     if (sent < 0)
     {
@@ -40,13 +58,14 @@ int send_query(std::vector<uint8_t> &packet, const std::string &server_ip, uint1
         return -1;
     }
 
+    if (mode == TransportMode::Record)
+        transport_record_send(sockfd, data, len, server_ip, port);
     return sockfd;
 }
 
-std::vector<uint8_t> recv_response(int sockfd, int timeout_secs)
+// Waits for one datagram into buf. Returns bytes received or -1.
+static ssize_t recv_socket(int sockfd, int timeout_secs, uint8_t *buf, size_t cap)
 {
-    std::vector<uint8_t> response(MAX_DNS_RESPONSE);
-
     timeval tv{};
     tv.tv_sec = timeout_secs;
     tv.tv_usec = 0;
@@ -54,18 +73,15 @@ std::vector<uint8_t> recv_response(int sockfd, int timeout_secs)
     if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
     {
         std::cerr << "Failed to set socket timeout.\n";
-        close(sockfd);
-        return {};
+        return -1;
     }
 
     sockaddr_in from_addr{};
     socklen_t from_len = sizeof(from_addr);
 
-    ssize_t received = recvfrom(sockfd, response.data(), response.size(), 0,
+    ssize_t received = recvfrom(sockfd, buf, cap, 0,
                                 reinterpret_cast<sockaddr *>(&from_addr), &from_len);
 
-    close(sockfd);
-
     if (received < 0)
     {
         if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -76,9 +92,117 @@ std::vector<uint8_t> recv_response(int sockfd, int timeout_secs)
         {
             std::cerr << "Error receiving DNS response.\n";
         }
-        return {};
+        return -1;
     }
 
+    return received;
+}
+
+// Like recv_socket, but closes sockfd and goes through the record/replay and
+// DoT layers
+static ssize_t recv_packet(int sockfd, int timeout_secs, uint8_t *buf, size_t cap)
+{
+    TransportMode mode = transport_mode();
+    if (mode == TransportMode::Replay)
+        return transport_replay_recv(sockfd, buf, cap);
+
+    bool dot = dot_enabled();
+    ssize_t received = dot ? dot_recv(sockfd, timeout_secs, buf, cap)
+                           : recv_socket(sockfd, timeout_secs, buf, cap);
+    if (mode == TransportMode::Record)
+        transport_record_recv(sockfd, buf, received); // before close: the fd number is the key
+    if (!dot)
+        close(sockfd);
+    return received;
+}
+
+int send_query(std::vector<uint8_t> &packet, const std::string &server_ip, uint16_t port)
+{
+    return send_packet(packet.data(), packet.size(), server_ip.c_str(), port);
+}
+
+int send_query(const std::pmr::vector<uint8_t> &packet, const std::pmr::string &server_ip, uint16_t port)
+{
+    return send_packet(packet.data(), packet.size(), server_ip.c_str(), port);
+}
+
+std::vector<uint8_t> recv_response(int sockfd, int timeout_secs)
+{
+    std::vector<uint8_t> response(MAX_DNS_RESPONSE);
+    ssize_t received = recv_packet(sockfd, timeout_secs, response.data(), response.size());
+    if (received < 0)
+        return {};
+
     response.resize(received);
     return response;
 }
+
+bool recv_response(int sockfd, int timeout_secs, std::pmr::vector<uint8_t> &out)
+{
+    out.resize(MAX_DNS_RESPONSE);
+    ssize_t received = recv_packet(sockfd, timeout_secs, out.data(), out.size());
+    if (received < 0)
+    {
+        out.clear();
+        return false;
+    }
+
+    out.resize(received);
+    return true;
+}
+
+void recv_responses(const int *sockfds, size_t n, int timeout_secs, std::pmr::vector<uint8_t> *out, bool *ok)
+{
+    using Clock = std::chrono::steady_clock;
+    auto deadline = Clock::now() + std::chrono::seconds(timeout_secs);
+    for (size_t i = 0; i < n; ++i)
+        ok[i] = false;
+
+    // Replay answers at once and DoT waits on its own connection; both just
+    // get whatever is left of the deadline for each reply in turn
+    TransportMode mode = transport_mode();
+    if (mode == TransportMode::Replay || dot_enabled())
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (sockfds[i] < 0)
+                continue;
+            auto left = std::chrono::ceil<std::chrono::seconds>(deadline - Clock::now()).count();
+            ok[i] = recv_response(sockfds[i], static_cast<int>(std::max<decltype(left)>(left, 0)), out[i]);
+        }
+        return;
+    }
+
+    std::vector<pollfd> pfds(n);
+    size_t waiting = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        pfds[i] = pollfd{sockfds[i], POLLIN, 0}; // poll() skips negative fds
+        waiting += sockfds[i] >= 0;
+    }
+    while (waiting > 0)
+    {
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left <= 0 || poll(pfds.data(), n, static_cast<int>(left)) <= 0)
+            break;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (pfds[i].fd < 0 || pfds[i].revents == 0)
+                continue;
+            ok[i] = recv_response(pfds[i].fd, 1, out[i]); // readable: does not wait
+            pfds[i].fd = -1;
+            waiting--;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (pfds[i].fd < 0)
+            continue;
+        std::cerr << "TIMEOUT: No response received.\n";
+        if (mode == TransportMode::Record)
+            transport_record_recv(pfds[i].fd, nullptr, -1);
+        close(pfds[i].fd);
+        out[i].clear();
+    }
+}
@@ -0,0 +1,545 @@
+#include "dns_dot.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+// Keep clear of real fds and of replay handles (1 << 24 upwards)
+constexpr int DOT_HANDLE_BASE = 1 << 26;
+constexpr int CONNECT_TIMEOUT_SECS = 3;
+constexpr int SEND_TIMEOUT_SECS = 3;
+// Timed-out IDs whose late replies a connection may still see; past this
+// it is retired and the next query opens a fresh one
+constexpr size_t MAX_ABANDONED = 1024;
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    struct DotConnection
+    {
+        std::string upstream;
+        int fd = -1;
+        SSL *ssl = nullptr;
+
+        // The SSL object is only touched under this mutex. Waiters take turns
+        // draining the socket (`reading`); the others sleep on cv.
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool reading = false;
+        bool broken = false;
+        bool retired = false; // takes no new queries; closes when the last waiter lets go
+        uint16_t next_id = 0;
+        std::vector<uint8_t> rx; // bytes of a frame not yet complete
+        std::unordered_set<uint16_t> in_flight;                   // sent, reply not yet taken
+        std::unordered_map<uint16_t, std::vector<uint8_t>> ready; // wire ID -> reply, IDs in flight only
+        std::unordered_set<uint16_t> abandoned;                   // timed out; drop the reply
+
+        ~DotConnection()
+        {
+            if (ssl)
+            {
+                if (!broken)
+                    SSL_shutdown(ssl); // one-shot close_notify, no wait for the peer's
+                SSL_free(ssl);
+            }
+            if (fd >= 0)
+                close(fd);
+        }
+    };
+
+    struct DotUpstream
+    {
+        std::mutex connect_mutex; // one handshake at a time per upstream
+        std::shared_ptr<DotConnection> conn;
+        SSL_SESSION *session = nullptr; // latest ticket; guarded by g_mutex
+    };
+
+    struct PendingQuery
+    {
+        std::shared_ptr<DotConnection> conn;
+        uint16_t wire_id = 0;
+        uint8_t id[2] = {0, 0};
+    };
+}
+
+// Lock order: connect_mutex, then a connection's mutex, then g_mutex.
+static std::mutex g_mutex;
+static std::atomic<bool> g_enabled{false};
+static DotOptions g_opts;
+static SSL_CTX *g_ctx = nullptr;
+static int g_conn_index = -1; // SSL ex_data slot holding the DotConnection
+static std::unordered_map<std::string, std::unique_ptr<DotUpstream>> g_upstreams;
+static std::unordered_map<int, PendingQuery> g_pending;
+static int g_next_handle = DOT_HANDLE_BASE;
+
+static std::atomic<uint64_t> g_queries{0};
+static std::atomic<uint64_t> g_handshakes{0};
+static std::atomic<uint64_t> g_resumed{0};
+static std::atomic<uint64_t> g_max_in_flight{0};
+
+static void print_ssl_error(const char *what, const std::string &upstream)
+{
+    std::cerr << what << " " << upstream;
+    unsigned long e = ERR_get_error();
+    if (e != 0)
+    {
+        char buf[256];
+        ERR_error_string_n(e, buf, sizeof(buf));
+        std::cerr << ": " << buf;
+    }
+    std::cerr << "\n";
+    ERR_clear_error();
+}
+
+static int millis_until(Clock::time_point deadline)
+{
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    return left > 0 ? static_cast<int>(left) : 0;
+}
+
+static int wait_fd(int fd, short events, Clock::time_point deadline)
+{
+    pollfd pfd{fd, events, 0};
+    int rc;
+    do
+        rc = poll(&pfd, 1, millis_until(deadline));
+    while (rc < 0 && errno == EINTR);
+    return rc;
+}
+
+// Blocks until the SSL call that returned `rc` can be retried
+static bool wait_ssl(DotConnection &c, int rc, Clock::time_point deadline)
+{
+    int err = SSL_get_error(c.ssl, rc);
+    if (err == SSL_ERROR_WANT_READ)
+        return wait_fd(c.fd, POLLIN, deadline) > 0;
+    if (err == SSL_ERROR_WANT_WRITE)
+        return wait_fd(c.fd, POLLOUT, deadline) > 0;
+    return false;
+}
+
+static int tcp_connect(const char *ip, uint16_t port, Clock::time_point deadline)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0)
+    {
+        std::cerr << " Invalid server IP address.\n";
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        std::cerr << "Socket creation failed.\n";
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // small pipelined frames
+
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 && errno != EINPROGRESS)
+    {
+        std::cerr << "DoT connect to " << ip << ":" << port << " failed: " << std::strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (wait_fd(fd, POLLOUT, deadline) <= 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+    {
+        std::cerr << "DoT connect to " << ip << ":" << port << " failed: "
+                  << (err ? std::strerror(err) : "timed out") << "\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Keeps the newest ticket per upstream; returning 1 keeps our reference.
+static int on_new_session(SSL *ssl, SSL_SESSION *session)
+{
+    auto *conn = static_cast<DotConnection *>(SSL_get_ex_data(ssl, g_conn_index));
+    if (!conn || !SSL_SESSION_is_resumable(session))
+        return 0;
+    std::lock_guard<std::mutex> lock(g_mutex);
+    auto it = g_upstreams.find(conn->upstream);
+    if (it == g_upstreams.end())
+        return 0;
+    if (it->second->session)
+        SSL_SESSION_free(it->second->session);
+    it->second->session = session;
+    return 1;
+}
+
+static std::shared_ptr<DotConnection> connect_upstream(const std::string &ip)
+{
+    auto deadline = Clock::now() + std::chrono::seconds(CONNECT_TIMEOUT_SECS);
+    auto conn = std::make_shared<DotConnection>();
+    conn->upstream = ip;
+
+    std::string server_name;
+    uint16_t port;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (!g_ctx)
+            return nullptr;
+        port = g_opts.port;
+        server_name = g_opts.server_name;
+        conn->ssl = SSL_new(g_ctx);
+        auto it = g_upstreams.find(ip);
+        if (conn->ssl && g_opts.session_tickets && it != g_upstreams.end() && it->second->session)
+            SSL_set_session(conn->ssl, it->second->session);
+    }
+    if (!conn->ssl)
+    {
+        print_ssl_error("SSL_new failed for", ip);
+        return nullptr;
+    }
+
+    conn->fd = tcp_connect(ip.c_str(), port, deadline);
+    if (conn->fd < 0)
+        return nullptr;
+
+    SSL_set_fd(conn->ssl, conn->fd);
+    SSL_set_ex_data(conn->ssl, g_conn_index, conn.get());
+    if (!server_name.empty())
+    {
+        SSL_set_tlsext_host_name(conn->ssl, server_name.c_str());
+        SSL_set1_host(conn->ssl, server_name.c_str());
+    }
+    else
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(conn->ssl), ip.c_str());
+
+    ERR_clear_error();
+    int rc;
+    while ((rc = SSL_connect(conn->ssl)) != 1)
+    {
+        if (!wait_ssl(*conn, rc, deadline))
+        {
+            long verify = SSL_get_verify_result(conn->ssl);
+            if (verify != X509_V_OK)
+                std::cerr << "DoT certificate check failed for " << ip << ": "
+                          << X509_verify_cert_error_string(verify) << "\n";
+            else
+                print_ssl_error("DoT handshake failed with", ip);
+            conn->broken = true;
+            return nullptr;
+        }
+    }
+
+    g_handshakes.fetch_add(1, std::memory_order_relaxed);
+    if (SSL_session_reused(conn->ssl))
+        g_resumed.fetch_add(1, std::memory_order_relaxed);
+    return conn;
+}
+
+// Reads whatever has arrived and files complete frames by wire ID.
+// Caller holds c.mutex.
+static void drain(DotConnection &c)
+{
+    uint8_t buf[4096];
+    for (;;)
+    {
+        ERR_clear_error();
+        int n = SSL_read(c.ssl, buf, sizeof(buf));
+        if (n > 0)
+        {
+            c.rx.insert(c.rx.end(), buf, buf + n);
+            continue;
+        }
+        int err = SSL_get_error(c.ssl, n);
+        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            c.broken = true; // closed by the upstream, or a TLS error
+        break;
+    }
+
+    size_t pos = 0;
+    while (c.rx.size() - pos >= 2)
+    {
+        size_t len = (size_t(c.rx[pos]) << 8) | c.rx[pos + 1];
+        if (c.rx.size() - pos - 2 < len)
+            break;
+        const uint8_t *msg = c.rx.data() + pos + 2;
+        if (len >= 2)
+        {
+            uint16_t id = static_cast<uint16_t>((msg[0] << 8) | msg[1]);
+            if (c.in_flight.count(id))
+                c.ready[id].assign(msg, msg + len);
+            else
+                c.abandoned.erase(id); // late, or not ours
+        }
+        pos += 2 + len;
+    }
+    c.rx.erase(c.rx.begin(), c.rx.begin() + pos);
+}
+
+// An idle connection may have been closed by the upstream; find out before
+// writing to it rather than losing the query.
+static bool still_usable(DotConnection &c)
+{
+    std::lock_guard<std::mutex> lock(c.mutex);
+    if (!c.broken && c.in_flight.empty() && !c.reading && wait_fd(c.fd, POLLIN, Clock::now()) > 0)
+        drain(c);
+    return !c.broken && !c.retired;
+}
+
+bool dot_enable(const DotOptions &opts)
+{
+    dot_disable();
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx)
+    {
+        print_ssl_error("SSL_CTX_new failed", "");
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    int loaded = opts.ca_file.empty() ? SSL_CTX_set_default_verify_paths(ctx)
+                                      : SSL_CTX_load_verify_locations(ctx, opts.ca_file.c_str(), nullptr);
+    if (loaded != 1)
+    {
+        print_ssl_error("Cannot load CA certificates", opts.ca_file.empty() ? "(system)" : opts.ca_file);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    if (opts.session_tickets)
+    {
+        // Tickets are kept per upstream by on_new_session, not in OpenSSL's cache
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, on_new_session);
+    }
+    else
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_conn_index < 0)
+        g_conn_index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    g_ctx = ctx;
+    g_opts = opts;
+    g_queries = 0;
+    g_handshakes = 0;
+    g_resumed = 0;
+    g_max_in_flight = 0;
+    g_enabled = true;
+    return true;
+}
+
+void dot_disable()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_enabled = false;
+    g_pending.clear();
+    for (auto &kv : g_upstreams)
+    {
+        if (kv.second->session)
+            SSL_SESSION_free(kv.second->session);
+    }
+    g_upstreams.clear();
+    if (g_ctx)
+        SSL_CTX_free(g_ctx); // live SSL objects hold their own reference
+    g_ctx = nullptr;
+}
+
+bool dot_enabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+DotStats dot_stats()
+{
+    DotStats s;
+    s.queries = g_queries.load(std::memory_order_relaxed);
+    s.handshakes = g_handshakes.load(std::memory_order_relaxed);
+    s.resumed = g_resumed.load(std::memory_order_relaxed);
+    s.max_in_flight = g_max_in_flight.load(std::memory_order_relaxed);
+    return s;
+}
+
+int dot_send(const uint8_t *query, size_t len, const char *server_ip)
+{
+    if (len < 2 || len > 0xFFFF)
+        return -1;
+
+    std::string ip(server_ip);
+    DotUpstream *up;
+    bool reuse;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (!g_ctx)
+            return -1;
+        reuse = g_opts.reuse_connections;
+        auto &slot = g_upstreams[ip];
+        if (!slot)
+            slot.reset(new DotUpstream());
+        up = slot.get();
+    }
+
+    std::shared_ptr<DotConnection> conn;
+    if (reuse)
+    {
+        std::lock_guard<std::mutex> lock(up->connect_mutex);
+        if (up->conn && !still_usable(*up->conn))
+            up->conn.reset();
+        if (!up->conn)
+            up->conn = connect_upstream(ip);
+        conn = up->conn;
+    }
+    else
+        conn = connect_upstream(ip); // released after its one reply
+    if (!conn)
+        return -1;
+
+    // Two-byte length prefix, then the query under a connection-unique ID
+    std::vector<uint8_t> frame(2 + len);
+    frame[0] = static_cast<uint8_t>(len >> 8);
+    frame[1] = static_cast<uint8_t>(len);
+    std::memcpy(frame.data() + 2, query, len);
+
+    PendingQuery p;
+    p.conn = conn;
+    std::memcpy(p.id, query, 2);
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        if (conn->broken)
+            return -1;
+        // The 16-bit counter wraps on a long-lived connection: skip IDs
+        // still waiting for a reply, or whose late reply may yet arrive
+        size_t tries = 0;
+        while (conn->in_flight.count(conn->next_id) || conn->abandoned.count(conn->next_id))
+        {
+            conn->next_id++;
+            if (++tries > 0xffff)
+                return -1; // every ID taken
+        }
+        p.wire_id = conn->next_id++;
+        frame[2] = static_cast<uint8_t>(p.wire_id >> 8);
+        frame[3] = static_cast<uint8_t>(p.wire_id);
+
+        auto deadline = Clock::now() + std::chrono::seconds(SEND_TIMEOUT_SECS);
+        size_t off = 0;
+        ERR_clear_error();
+        while (off < frame.size())
+        {
+            int n = SSL_write(conn->ssl, frame.data() + off, static_cast<int>(frame.size() - off));
+            if (n > 0)
+                off += static_cast<size_t>(n);
+            else if (!wait_ssl(*conn, n, deadline))
+            {
+                conn->broken = true;
+                conn->cv.notify_all();
+                print_ssl_error("Failed to send DNS query over TLS to", ip);
+                return -1;
+            }
+        }
+
+        conn->in_flight.insert(p.wire_id);
+        uint64_t depth = conn->in_flight.size();
+        uint64_t seen = g_max_in_flight.load(std::memory_order_relaxed);
+        while (depth > seen && !g_max_in_flight.compare_exchange_weak(seen, depth, std::memory_order_relaxed))
+        {
+        }
+    }
+    g_queries.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    int handle = g_next_handle++;
+    if (g_next_handle < DOT_HANDLE_BASE)
+        g_next_handle = DOT_HANDLE_BASE;
+    g_pending[handle] = std::move(p);
+    return handle;
+}
+
+ssize_t dot_recv(int handle, int timeout_secs, uint8_t *buf, size_t cap)
+{
+    PendingQuery p;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        auto it = g_pending.find(handle);
+        if (it == g_pending.end())
+            return -1;
+        p = std::move(it->second);
+        g_pending.erase(it);
+    }
+
+    DotConnection &c = *p.conn;
+    auto deadline = Clock::now() + std::chrono::seconds(timeout_secs);
+    std::vector<uint8_t> reply;
+    bool got = false;
+    {
+        std::unique_lock<std::mutex> lock(c.mutex);
+        for (;;)
+        {
+            auto it = c.ready.find(p.wire_id);
+            if (it != c.ready.end())
+            {
+                reply = std::move(it->second);
+                c.ready.erase(it);
+                got = true;
+                break;
+            }
+            if (c.broken || Clock::now() >= deadline)
+                break;
+
+            if (c.reading)
+            {
+                c.cv.wait_until(lock, deadline);
+                continue;
+            }
+
+            // Our turn to read; the socket is polled without the lock so
+            // other threads can keep pipelining queries meanwhile.
+            c.reading = true;
+            lock.unlock();
+            int rc = wait_fd(c.fd, POLLIN, deadline);
+            lock.lock();
+            c.reading = false;
+            if (rc > 0)
+                drain(c);
+            c.cv.notify_all();
+        }
+        c.in_flight.erase(p.wire_id);
+        if (!got && !c.broken)
+        {
+            c.abandoned.insert(p.wire_id);
+            if (c.abandoned.size() >= MAX_ABANDONED)
+                c.retired = true;
+        }
+    }
+
+    if (!got)
+    {
+        if (c.broken)
+            std::cerr << "DoT connection to " << c.upstream << " was closed.\n";
+        else
+            std::cerr << "TIMEOUT: No response received.\n";
+        return -1;
+    }
+    if (reply.size() > cap)
+    {
+        std::cerr << "DoT response of " << reply.size() << " bytes exceeds the " << cap << "-byte buffer.\n";
+        return -1;
+    }
+    std::memcpy(buf, reply.data(), reply.size());
+    std::memcpy(buf, p.id, 2);
+    return static_cast<ssize_t>(reply.size());
+}
@@ -8,15 +8,15 @@
 
 uint16_t generate_transaction_id()
 {
-    static std::mt19937 rng(std::random_device{}());
-    static std::uniform_int_distribution<uint16_t> dist(0, 0xFFFF);
+    // Per thread: resolver workers build queries concurrently
+    static thread_local std::mt19937 rng(std::random_device{}());
+    static thread_local std::uniform_int_distribution<uint16_t> dist(0, 0xFFFF);
     return dist(rng);
 }
 
-std::vector<uint8_t> build_query_packet(const std::string &domain, uint16_t qtype)
+template <class Buf>
+static void append_query(std::string_view domain, uint16_t qtype, Buf &packet)
 {
-    std::vector<uint8_t> packet;
-
     DNSHeader hdr{};
     hdr.id = htons(generate_transaction_id());
     hdr.flags = htons(0x0100); // RD=1
@@ -26,8 +26,7 @@ std::vector<uint8_t> build_query_packet(const std::string &domain, uint16_t qtyp
                   reinterpret_cast<uint8_t *>(&hdr),
                   reinterpret_cast<uint8_t *>(&hdr) + sizeof(DNSHeader));
 
-    std::vector<uint8_t> qname = encode_domain(domain);
-    packet.insert(packet.end(), qname.begin(), qname.end());
+    encode_domain(domain, packet);
 
     uint16_t qtype_net = htons(qtype);
     uint16_t qclass_net = htons(1); // IN
@@ -38,10 +37,21 @@ std::vector<uint8_t> build_query_packet(const std::string &domain, uint16_t qtyp
     packet.insert(packet.end(),
                   reinterpret_cast<uint8_t *>(&qclass_net),
                   reinterpret_cast<uint8_t *>(&qclass_net) + 2);
+}
 
+std::vector<uint8_t> build_query_packet(const std::string &domain, uint16_t qtype)
+{
+    std::vector<uint8_t> packet;
+    append_query(domain, qtype, packet);
     return packet;
 }
 
+void build_query_packet(std::string_view domain, uint16_t qtype, std::pmr::vector<uint8_t> &out)
+{
+    out.clear();
+    append_query(domain, qtype, out);
+}
+
 std::vector<std::string>
 parse_response(const std::vector<uint8_t> &msg, uint16_t expected_qtype)
 {
@@ -130,3 +140,116 @@ parse_response(const std::vector<uint8_t> &msg, uint16_t expected_qtype)
 
     return out;
 }
+
+// Offset just past the first question, or 0 if it does not fit in `len`.
+static size_t question_end(const uint8_t *msg, size_t len)
+{
+    size_t off = sizeof(DNSHeader);
+    while (off < len && msg[off] != 0)
+    {
+        if ((msg[off] & 0xC0) != 0) // no compression inside a query's question
+            return 0;
+        off += 1 + msg[off];
+    }
+    off += 1 + 4; // root label + QTYPE + QCLASS
+    return off <= len ? off : 0;
+}
+
+bool parse_query_question(const uint8_t *msg, size_t len, std::string &name, uint16_t &qtype)
+{
+    if (len < sizeof(DNSHeader))
+        return false;
+    DNSHeader hdr;
+    std::memcpy(&hdr, msg, sizeof(DNSHeader));
+    if ((ntohs(hdr.flags) & 0x8000) != 0 || ntohs(hdr.QDCOUNT) == 0)
+        return false; // a response, or no question
+
+    size_t end = question_end(msg, len);
+    if (end == 0)
+        return false;
+
+    name.clear();
+    size_t off = sizeof(DNSHeader);
+    while (msg[off] != 0)
+    {
+        uint8_t label = msg[off++];
+        if (!name.empty())
+            name.push_back('.');
+        for (uint8_t i = 0; i < label; ++i)
+        {
+            char c = static_cast<char>(msg[off + i]);
+            name.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+        }
+        off += label;
+    }
+    qtype = static_cast<uint16_t>((msg[end - 4] << 8) | msg[end - 3]);
+    return true;
+}
+
+static void append_u16(std::vector<uint8_t> &out, uint16_t v)
+{
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static void append_u32(std::vector<uint8_t> &out, uint32_t v)
+{
+    append_u16(out, static_cast<uint16_t>(v >> 16));
+    append_u16(out, static_cast<uint16_t>(v));
+}
+
+bool build_response_packet(const uint8_t *query, size_t query_len, uint16_t qtype,
+                           const std::vector<std::string> &answers, uint32_t ttl,
+                           uint8_t rcode, std::vector<uint8_t> &out)
+{
+    size_t end = question_end(query, query_len);
+    if (end == 0)
+        return false;
+
+    out.assign(query, query + end);
+    uint16_t ancount = 0;
+    for (const auto &a : answers)
+    {
+        size_t rr_start = out.size();
+        append_u16(out, 0xC000 | sizeof(DNSHeader)); // owner: pointer to QNAME
+        append_u16(out, qtype);
+        append_u16(out, 1); // IN
+        append_u32(out, ttl);
+        size_t rdlen_at = out.size();
+        append_u16(out, 0);
+
+        uint8_t addr[16];
+        if (qtype == 1 && inet_pton(AF_INET, a.c_str(), addr) == 1)
+            out.insert(out.end(), addr, addr + 4);
+        else if (qtype == 28 && inet_pton(AF_INET6, a.c_str(), addr) == 1)
+            out.insert(out.end(), addr, addr + 16);
+        else if (qtype == 5)
+            encode_domain(a, out);
+        else if (qtype == 15)
+        {
+            append_u16(out, 10); // the cache keeps only the exchange, not its preference
+            encode_domain(a, out);
+        }
+        else
+        {
+            out.resize(rr_start); // not representable as this type
+            continue;
+        }
+
+        uint16_t rdlen = static_cast<uint16_t>(out.size() - rdlen_at - 2);
+        out[rdlen_at] = static_cast<uint8_t>(rdlen >> 8);
+        out[rdlen_at + 1] = static_cast<uint8_t>(rdlen);
+        ancount++;
+    }
+
+    DNSHeader hdr;
+    std::memcpy(&hdr, out.data(), sizeof(DNSHeader));
+    uint16_t rd = ntohs(hdr.flags) & 0x0100;
+    hdr.flags = htons(static_cast<uint16_t>(0x8000 | rd | 0x0080 | (rcode & 0x0F))); // QR, RD echoed, RA
+    hdr.QDCOUNT = htons(1);
+    hdr.ANCOUNT = htons(ancount);
+    hdr.NSCOUNT = 0;
+    hdr.ARCOUNT = 0;
+    std::memcpy(out.data(), &hdr, sizeof(DNSHeader));
+    return true;
+}
@@ -0,0 +1,645 @@
+#include "dns_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+constexpr size_t MAX_DATAGRAM = 512;
+constexpr int LOOP_TIMEOUT_MS = 100; // how often `stop` is checked when idle
+constexpr int SOCKET_BUFFER_BYTES = 4 << 20;
+
+// epoll backend
+constexpr unsigned MMSG_BATCH = 64;
+
+// io_uring backend
+constexpr unsigned URING_SQ_ENTRIES = 256;
+constexpr unsigned URING_CQ_ENTRIES = 4096;
+constexpr unsigned RECV_BUFFERS = 1024; // provided buffer ring, power of two
+constexpr unsigned RECV_BUFFER_BYTES = 2048;
+constexpr uint16_t RECV_BUFFER_GROUP = 1;
+constexpr unsigned SEND_SLOTS = 1024;
+constexpr unsigned SEND_SLOT_BYTES = 2048;
+
+UdpServer::~UdpServer()
+{
+    if (sock_ >= 0)
+        close(sock_);
+    if (wake_fd_ >= 0)
+        close(wake_fd_);
+}
+
+bool UdpServer::open(const ServerOptions &opts)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    if (inet_pton(AF_INET, opts.listen_ip.c_str(), &addr.sin_addr) <= 0)
+    {
+        std::cerr << "Invalid listen address " << opts.listen_ip << "\n";
+        return false;
+    }
+
+    sock_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock_ < 0)
+    {
+        std::cerr << "Socket creation failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    int one = 1;
+    setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, &SOCKET_BUFFER_BYTES, sizeof(SOCKET_BUFFER_BYTES));
+    setsockopt(sock_, SOL_SOCKET, SO_SNDBUF, &SOCKET_BUFFER_BYTES, sizeof(SOCKET_BUFFER_BYTES));
+    if (bind(sock_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        std::cerr << "Cannot bind " << opts.listen_ip << ":" << opts.port << ": "
+                  << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0)
+    {
+        std::cerr << "eventfd failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    requested_ = opts.io;
+    return true;
+}
+
+// Lock-free for the resolver workers; the eventfd is only written when the
+// loop has not been woken since it last drained the queue
+void UdpServer::reply(const sockaddr_in &to, std::vector<uint8_t> response)
+{
+    deferred_.push(Deferred{to, std::move(response)});
+    uint64_t one = 1;
+    if (!wake_pending_.exchange(true))
+        (void)!write(wake_fd_, &one, sizeof(one));
+}
+
+void UdpServer::take_deferred(std::vector<Deferred> &out)
+{
+    uint64_t count;
+    (void)!read(wake_fd_, &count, sizeof(count));
+    wake_pending_.exchange(false); // before draining: a later reply() wakes us again
+    Deferred d;
+    while (deferred_.pop(d))
+        out.push_back(std::move(d));
+}
+
+bool UdpServer::run(const Handler &handler, const volatile std::sig_atomic_t &stop)
+{
+    if (sock_ < 0)
+        return false;
+
+    if (requested_ != ServerIo::Epoll)
+    {
+        backend_ = ServerIo::IoUring;
+        int rc = run_uring(handler, stop);
+        if (rc != 0)
+            return rc > 0;
+        if (requested_ == ServerIo::IoUring)
+        {
+            std::cerr << "io_uring listener is not supported by this kernel.\n";
+            return false;
+        }
+        std::cerr << "io_uring unavailable, falling back to epoll.\n";
+    }
+
+    backend_ = ServerIo::Epoll;
+    return run_epoll(handler, stop);
+}
+
+// ---------------------------------------------------------------------------
+// epoll + recvmmsg/sendmmsg
+
+bool UdpServer::run_epoll(const Handler &handler, const volatile std::sig_atomic_t &stop)
+{
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0)
+    {
+        std::cerr << "epoll_create1 failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = sock_;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sock_, &ev);
+    ev.data.fd = wake_fd_;
+    epoll_ctl(ep, EPOLL_CTL_ADD, wake_fd_, &ev);
+
+    std::vector<uint8_t> in_mem(size_t(MMSG_BATCH) * MAX_DATAGRAM);
+    sockaddr_in in_addrs[MMSG_BATCH];
+    iovec in_iov[MMSG_BATCH];
+    mmsghdr in_msgs[MMSG_BATCH];
+
+    std::vector<std::vector<uint8_t>> out_bufs(MMSG_BATCH);
+    sockaddr_in out_addrs[MMSG_BATCH];
+    iovec out_iov[MMSG_BATCH];
+    mmsghdr out_msgs[MMSG_BATCH];
+    unsigned out_count = 0;
+
+    auto flush = [&]()
+    {
+        unsigned done = 0;
+        while (done < out_count)
+        {
+            int n = sendmmsg(sock_, out_msgs + done, out_count - done, 0);
+            stats_.syscalls++;
+            if (n <= 0)
+            {
+                stats_.dropped += out_count - done;
+                break;
+            }
+            stats_.sent += n;
+            done += n;
+        }
+        out_count = 0;
+    };
+    auto queue = [&](const sockaddr_in &to, std::vector<uint8_t> &response)
+    {
+        if (out_count == MMSG_BATCH)
+            flush();
+        out_bufs[out_count].swap(response);
+        out_addrs[out_count] = to;
+        out_iov[out_count] = {out_bufs[out_count].data(), out_bufs[out_count].size()};
+        out_msgs[out_count] = {};
+        out_msgs[out_count].msg_hdr.msg_name = &out_addrs[out_count];
+        out_msgs[out_count].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        out_msgs[out_count].msg_hdr.msg_iov = &out_iov[out_count];
+        out_msgs[out_count].msg_hdr.msg_iovlen = 1;
+        out_count++;
+    };
+
+    std::vector<uint8_t> response;
+    std::vector<Deferred> deferred;
+    epoll_event events[2];
+    while (!stop)
+    {
+        int n = epoll_wait(ep, events, 2, LOOP_TIMEOUT_MS);
+        stats_.syscalls++;
+        if (n < 0 && errno != EINTR)
+        {
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << "\n";
+            close(ep);
+            return false;
+        }
+
+        for (int e = 0; e < n; ++e)
+        {
+            if (events[e].data.fd == wake_fd_)
+            {
+                take_deferred(deferred);
+                for (auto &d : deferred)
+                    queue(d.to, d.response);
+                deferred.clear();
+                continue;
+            }
+
+            for (;;)
+            {
+                for (unsigned i = 0; i < MMSG_BATCH; ++i)
+                {
+                    in_iov[i] = {in_mem.data() + size_t(i) * MAX_DATAGRAM, MAX_DATAGRAM};
+                    in_msgs[i] = {};
+                    in_msgs[i].msg_hdr.msg_name = &in_addrs[i];
+                    in_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                    in_msgs[i].msg_hdr.msg_iov = &in_iov[i];
+                    in_msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                int got = recvmmsg(sock_, in_msgs, MMSG_BATCH, MSG_DONTWAIT, nullptr);
+                stats_.syscalls++;
+                if (got <= 0)
+                    break;
+                stats_.received += got;
+                for (int i = 0; i < got; ++i)
+                {
+                    if (handler(static_cast<uint8_t *>(in_iov[i].iov_base), in_msgs[i].msg_len, in_addrs[i], response))
+                        queue(in_addrs[i], response);
+                }
+                flush();
+                if (static_cast<unsigned>(got) < MMSG_BATCH)
+                    break;
+            }
+        }
+        flush();
+    }
+
+    close(ep);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// io_uring (raw syscalls; liburing is not required)
+
+namespace
+{
+    enum : uint64_t
+    {
+        OP_RECV = 1,
+        OP_SEND = 2,
+        OP_WAKE = 3,
+    };
+
+    inline uint64_t user_data(uint64_t op, uint32_t index) { return (op << 32) | index; }
+
+    int sys_io_uring_setup(unsigned entries, io_uring_params *p)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                           const void *arg, size_t argsz)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+    }
+
+    int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr));
+    }
+
+    template <class T>
+    T load_acquire(const T *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+    template <class T>
+    void store_release(T *p, T v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+    struct Ring
+    {
+        int fd = -1;
+        void *sq_map = MAP_FAILED, *cq_map = MAP_FAILED;
+        size_t sq_map_len = 0, cq_map_len = 0;
+        io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+        size_t sqes_len = 0;
+
+        unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr;
+        unsigned sq_mask = 0, sq_entries = 0;
+        unsigned *cq_head = nullptr, *cq_tail = nullptr;
+        unsigned cq_mask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        unsigned local_tail = 0; // SQEs prepared
+        unsigned submitted = 0;  // SQEs handed to the kernel
+
+        ~Ring()
+        {
+            if (sqes != MAP_FAILED)
+                munmap(sqes, sqes_len);
+            if (cq_map != MAP_FAILED && cq_map != sq_map)
+                munmap(cq_map, cq_map_len);
+            if (sq_map != MAP_FAILED)
+                munmap(sq_map, sq_map_len);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        bool init()
+        {
+            io_uring_params p{};
+            p.flags = IORING_SETUP_CQSIZE;
+            p.cq_entries = URING_CQ_ENTRIES;
+            fd = sys_io_uring_setup(URING_SQ_ENTRIES, &p);
+            if (fd < 0)
+                return false;
+
+            sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single)
+                sq_map_len = cq_map_len = std::max(sq_map_len, cq_map_len);
+
+            sq_map = mmap(nullptr, sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                          IORING_OFF_SQ_RING);
+            if (sq_map == MAP_FAILED)
+                return false;
+            cq_map = single ? sq_map
+                            : mmap(nullptr, cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                   IORING_OFF_CQ_RING);
+            if (cq_map == MAP_FAILED)
+                return false;
+            sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED)
+                return false;
+
+            auto *sq = static_cast<uint8_t *>(sq_map);
+            sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+            sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+            sq_entries = p.sq_entries;
+            sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+            auto *cq = static_cast<uint8_t *>(cq_map);
+            cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+            cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+            local_tail = submitted = *sq_tail;
+            return true;
+        }
+
+        // Submits everything prepared and waits for `wait_nr` completions
+        // (bounded by LOOP_TIMEOUT_MS). Returns false on a fatal error.
+        bool submit(unsigned wait_nr)
+        {
+            store_release(sq_tail, local_tail);
+            __kernel_timespec ts{0, static_cast<long long>(LOOP_TIMEOUT_MS) * 1000000};
+            io_uring_getevents_arg arg{};
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            unsigned flags = IORING_ENTER_EXT_ARG | (wait_nr ? IORING_ENTER_GETEVENTS : 0);
+            int ret = sys_io_uring_enter(fd, local_tail - submitted, wait_nr, flags, &arg, sizeof(arg));
+            if (ret >= 0)
+            {
+                submitted += static_cast<unsigned>(ret);
+                return true;
+            }
+            return errno == EINTR || errno == ETIME || errno == EAGAIN || errno == EBUSY;
+        }
+
+        io_uring_sqe *get_sqe()
+        {
+            if (local_tail - load_acquire(sq_head) >= sq_entries)
+            {
+                if (!submit(0) || local_tail - load_acquire(sq_head) >= sq_entries)
+                    return nullptr;
+            }
+            unsigned idx = local_tail & sq_mask;
+            sq_array[idx] = idx;
+            io_uring_sqe *sqe = &sqes[idx];
+            std::memset(sqe, 0, sizeof(*sqe));
+            local_tail++;
+            return sqe;
+        }
+    };
+
+    // Provided buffer ring the kernel picks receive buffers from.
+    struct BufferRing
+    {
+        io_uring_buf_ring *ring = static_cast<io_uring_buf_ring *>(MAP_FAILED);
+        size_t ring_len = 0;
+        std::vector<uint8_t> memory;
+        uint16_t tail = 0;
+
+        ~BufferRing()
+        {
+            if (ring != MAP_FAILED)
+                munmap(ring, ring_len);
+        }
+
+        bool init(int ring_fd)
+        {
+            ring_len = RECV_BUFFERS * sizeof(io_uring_buf);
+            ring = static_cast<io_uring_buf_ring *>(mmap(nullptr, ring_len, PROT_READ | PROT_WRITE,
+                                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (ring == MAP_FAILED)
+                return false;
+
+            memory.resize(size_t(RECV_BUFFERS) * RECV_BUFFER_BYTES);
+            for (uint16_t bid = 0; bid < RECV_BUFFERS; ++bid)
+                add(bid);
+            publish();
+
+            io_uring_buf_reg reg{};
+            reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+            reg.ring_entries = RECV_BUFFERS;
+            reg.bgid = RECV_BUFFER_GROUP;
+            return sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+        }
+
+        uint8_t *buffer(uint16_t bid) { return memory.data() + size_t(bid) * RECV_BUFFER_BYTES; }
+
+        // Writes addr/len/bid only: entry 0's resv doubles as the ring tail.
+        // Entries are indexed by hand: in C++ the header's flexible `bufs`
+        // member does not start at offset 0.
+        void add(uint16_t bid)
+        {
+            io_uring_buf &b = reinterpret_cast<io_uring_buf *>(ring)[tail & (RECV_BUFFERS - 1)];
+            b.addr = reinterpret_cast<uint64_t>(buffer(bid));
+            b.len = RECV_BUFFER_BYTES;
+            b.bid = bid;
+            tail++;
+        }
+
+        void publish() { store_release(&ring->tail, tail); }
+    };
+
+    struct SendSlot
+    {
+        sockaddr_in to;
+        iovec iov;
+        msghdr msg;
+        uint8_t *data;
+        uint32_t len;
+    };
+}
+
+int UdpServer::run_uring(const Handler &handler, const volatile std::sig_atomic_t &stop)
+{
+    Ring ring;
+    if (!ring.init())
+        return 0;
+    BufferRing bufs;
+    if (!bufs.init(ring.fd))
+        return 0;
+
+    // Reply buffers are registered once so fixed-buffer sends skip the per-I/O
+    // page pinning; kernels that reject that (or sendto-style SEND) get
+    // SENDMSG on the same slots.
+    std::vector<uint8_t> send_memory(size_t(SEND_SLOTS) * SEND_SLOT_BYTES);
+    iovec reg{send_memory.data(), send_memory.size()};
+    bool fixed_send = sys_io_uring_register(ring.fd, IORING_REGISTER_BUFFERS, &reg, 1) == 0;
+    bool plain_send = true;
+
+    std::vector<SendSlot> slots(SEND_SLOTS);
+    std::vector<uint32_t> free_slots;
+    free_slots.reserve(SEND_SLOTS);
+    for (uint32_t i = 0; i < SEND_SLOTS; ++i)
+    {
+        slots[i].data = send_memory.data() + size_t(i) * SEND_SLOT_BYTES;
+        free_slots.push_back(SEND_SLOTS - 1 - i);
+    }
+
+    msghdr recv_msg{};
+    recv_msg.msg_namelen = sizeof(sockaddr_in);
+
+    auto arm_recv = [&]()
+    {
+        io_uring_sqe *sqe = ring.get_sqe();
+        if (!sqe)
+            return false;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sock_;
+        sqe->addr = reinterpret_cast<uint64_t>(&recv_msg);
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_BUFFER_GROUP;
+        sqe->user_data = user_data(OP_RECV, 0);
+        return true;
+    };
+    auto arm_wake = [&]()
+    {
+        io_uring_sqe *sqe = ring.get_sqe();
+        if (!sqe)
+            return false;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = wake_fd_;
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = user_data(OP_WAKE, 0);
+        return true;
+    };
+    auto submit_send = [&](uint32_t slot_index)
+    {
+        SendSlot &s = slots[slot_index];
+        io_uring_sqe *sqe = ring.get_sqe();
+        if (!sqe)
+        {
+            free_slots.push_back(slot_index);
+            stats_.dropped++;
+            return;
+        }
+        sqe->fd = sock_;
+        sqe->user_data = user_data(OP_SEND, slot_index);
+        if (plain_send)
+        {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = reinterpret_cast<uint64_t>(s.data);
+            sqe->len = s.len;
+            sqe->addr2 = reinterpret_cast<uint64_t>(&s.to);
+            sqe->addr_len = sizeof(sockaddr_in);
+            if (fixed_send)
+            {
+                sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+                sqe->buf_index = 0;
+            }
+        }
+        else
+        {
+            s.iov = {s.data, s.len};
+            s.msg = {};
+            s.msg.msg_name = &s.to;
+            s.msg.msg_namelen = sizeof(sockaddr_in);
+            s.msg.msg_iov = &s.iov;
+            s.msg.msg_iovlen = 1;
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = reinterpret_cast<uint64_t>(&s.msg);
+            sqe->len = 1;
+        }
+    };
+    auto queue_send = [&](const sockaddr_in &to, const std::vector<uint8_t> &response)
+    {
+        if (free_slots.empty() || response.size() > SEND_SLOT_BYTES)
+        {
+            stats_.dropped++;
+            return;
+        }
+        uint32_t idx = free_slots.back();
+        free_slots.pop_back();
+        SendSlot &s = slots[idx];
+        s.to = to;
+        s.len = static_cast<uint32_t>(response.size());
+        std::memcpy(s.data, response.data(), response.size());
+        submit_send(idx);
+    };
+
+    if (!arm_recv() || !arm_wake())
+        return 0;
+
+    std::vector<uint8_t> response;
+    std::vector<Deferred> deferred;
+    bool receiving = false; // a multishot receive has produced data
+    while (!stop)
+    {
+        stats_.syscalls++;
+        if (!ring.submit(1))
+        {
+            std::cerr << "io_uring_enter failed: " << std::strerror(errno) << "\n";
+            return receiving ? -1 : 0;
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = load_acquire(ring.cq_tail);
+        for (; head != tail; ++head)
+        {
+            io_uring_cqe cqe = ring.cqes[head & ring.cq_mask];
+            uint64_t op = cqe.user_data >> 32;
+            uint32_t index = static_cast<uint32_t>(cqe.user_data);
+            bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+            if (op == OP_RECV)
+            {
+                if (cqe.res < 0)
+                {
+                    // ENOBUFS: every buffer is in flight; re-arm after recycling
+                    if (!receiving && cqe.res == -EINVAL)
+                        return 0; // no multishot receive on this kernel
+                    if (cqe.res != -ENOBUFS)
+                        std::cerr << "io_uring receive failed: " << std::strerror(-cqe.res) << "\n";
+                }
+                else if (cqe.flags & IORING_CQE_F_BUFFER)
+                {
+                    receiving = true;
+                    uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    uint8_t *buf = bufs.buffer(bid);
+                    io_uring_recvmsg_out out;
+                    std::memcpy(&out, buf, sizeof(out));
+                    const uint8_t *name = buf + sizeof(out);
+                    const uint8_t *payload = name + recv_msg.msg_namelen + recv_msg.msg_controllen;
+                    size_t avail = static_cast<size_t>(cqe.res) - (payload - buf);
+                    size_t len = std::min<size_t>(out.payloadlen, avail);
+
+                    sockaddr_in from{};
+                    std::memcpy(&from, name, std::min<size_t>(out.namelen, sizeof(from)));
+                    stats_.received++;
+                    if (handler(payload, len, from, response))
+                        queue_send(from, response);
+                    bufs.add(bid);
+                }
+                if (!more && !arm_recv())
+                    return -1;
+            }
+            else if (op == OP_SEND)
+            {
+                if (cqe.res == -EINVAL && (fixed_send || plain_send))
+                {
+                    // Downgrade once: fixed SEND -> SEND -> SENDMSG
+                    if (fixed_send)
+                        fixed_send = false;
+                    else
+                        plain_send = false;
+                    submit_send(index);
+                    continue;
+                }
+                if (cqe.res < 0)
+                    stats_.dropped++;
+                else
+                    stats_.sent++;
+                free_slots.push_back(index);
+            }
+            else if (op == OP_WAKE)
+            {
+                take_deferred(deferred);
+                for (auto &d : deferred)
+                    queue_send(d.to, d.response);
+                deferred.clear();
+                if (!more && !arm_wake())
+                    return -1;
+            }
+        }
+        store_release(ring.cq_head, head);
+        bufs.publish();
+    }
+    return 1;
+}
@@ -0,0 +1,309 @@
+#include "dns_transport.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char CAPTURE_MAGIC[8] = {'D', 'N', 'S', 'C', 'A', 'P', '0', '1'};
+constexpr size_t DNS_HEADER_LEN = 12;
+
+// Replay handles are not file descriptors; keep them well clear of real fds.
+constexpr int REPLAY_HANDLE_BASE = 1 << 24;
+
+using Clock = std::chrono::steady_clock;
+
+struct RecordedReply
+{
+    std::vector<uint8_t> response; // empty = upstream never answered
+    bool answered = false;
+    uint64_t latency_us = 0;
+};
+
+struct ReplayQueue
+{
+    std::vector<RecordedReply> replies;
+    size_t next = 0;
+};
+
+struct PendingSend
+{
+    std::string key;
+    std::string server;
+    std::vector<uint8_t> query;
+    Clock::time_point sent_at;
+};
+
+static std::atomic<TransportMode> g_mode{TransportMode::Live};
+static std::mutex g_mutex;
+static std::ofstream g_capture;
+static bool g_zero_latency = false;
+static std::unordered_map<std::string, ReplayQueue> g_replay;
+static std::unordered_map<int, PendingSend> g_pending; // sockfd / replay handle -> query
+static int g_next_handle = REPLAY_HANDLE_BASE;
+
+static std::string server_key(const char *server_ip, uint16_t port)
+{
+    return std::string(server_ip) + ":" + std::to_string(port);
+}
+
+// Upstream + question section with the name case-folded; the transaction ID
+// (and the rest of the header) is excluded so replays match any ID.
+static std::string exchange_key(const std::string &server, const uint8_t *query, size_t len)
+{
+    std::string key = server;
+    key.push_back('\0');
+    if (len <= DNS_HEADER_LEN)
+        return key;
+
+    size_t start = key.size();
+    key.append(reinterpret_cast<const char *>(query + DNS_HEADER_LEN), len - DNS_HEADER_LEN);
+    size_t pos = start;
+    while (pos < key.size())
+    {
+        uint8_t label = static_cast<uint8_t>(key[pos]);
+        if (label == 0 || label > 63)
+            break;
+        for (size_t i = pos + 1; i <= pos + label && i < key.size(); ++i)
+        {
+            if (key[i] >= 'A' && key[i] <= 'Z')
+                key[i] = static_cast<char>(key[i] - 'A' + 'a');
+        }
+        pos += label + 1;
+    }
+    return key;
+}
+
+template <class T>
+static void put_raw(std::ofstream &out, T v)
+{
+    out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+bool transport_start_recording(const std::string &path)
+{
+    transport_stop();
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_capture.open(path, std::ios::binary | std::ios::trunc);
+    if (!g_capture)
+    {
+        std::cerr << "Cannot write capture file " << path << "\n";
+        return false;
+    }
+    g_capture.write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    g_mode = TransportMode::Record;
+    return true;
+}
+
+bool transport_start_replay(const std::string &path, bool zero_latency)
+{
+    transport_stop();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot open capture file " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(CAPTURE_MAGIC))
+    {
+        std::cerr << "Capture file " << path << " is truncated.\n";
+        ::close(fd);
+        return false;
+    }
+    size_t len = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Cannot mmap capture file " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    const uint8_t *p = static_cast<const uint8_t *>(map);
+    const uint8_t *end = p + len;
+    if (std::memcmp(p, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+    {
+        std::cerr << path << " is not a DNS capture file.\n";
+        munmap(map, len);
+        return false;
+    }
+    p += sizeof(CAPTURE_MAGIC);
+
+    auto take = [&](void *dst, size_t n)
+    {
+        if (static_cast<size_t>(end - p) < n)
+            return false;
+        std::memcpy(dst, p, n);
+        p += n;
+        return true;
+    };
+
+    std::unordered_map<std::string, ReplayQueue> replay;
+    size_t records = 0;
+    bool ok = true;
+    while (p < end)
+    {
+        uint16_t server_len = 0, query_len = 0;
+        int32_t response_len = 0;
+        std::string server;
+        std::vector<uint8_t> query;
+        RecordedReply reply;
+
+        ok = take(&server_len, sizeof(server_len));
+        if (ok)
+        {
+            server.resize(server_len);
+            ok = take(server.data(), server_len) && take(&query_len, sizeof(query_len));
+        }
+        if (ok)
+        {
+            query.resize(query_len);
+            ok = take(query.data(), query_len) && take(&response_len, sizeof(response_len));
+        }
+        if (ok && response_len >= 0)
+        {
+            reply.answered = true;
+            reply.response.resize(static_cast<size_t>(response_len));
+            ok = take(reply.response.data(), reply.response.size());
+        }
+        if (ok)
+            ok = take(&reply.latency_us, sizeof(reply.latency_us));
+        if (!ok)
+            break;
+
+        replay[exchange_key(server, query.data(), query.size())].replies.push_back(std::move(reply));
+        records++;
+    }
+    munmap(map, len);
+
+    if (!ok)
+        std::cerr << "Capture file " << path << " is truncated after " << records << " exchanges.\n";
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_replay = std::move(replay);
+    g_zero_latency = zero_latency;
+    g_mode = TransportMode::Replay;
+    return true;
+}
+
+void transport_stop()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (g_capture.is_open())
+        g_capture.close();
+    g_replay.clear();
+    g_pending.clear();
+    g_mode = TransportMode::Live;
+}
+
+TransportMode transport_mode()
+{
+    return g_mode.load(std::memory_order_relaxed);
+}
+
+int transport_replay_send(const uint8_t *query, size_t len, const char *server_ip, uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    int handle = g_next_handle++;
+    if (g_next_handle < REPLAY_HANDLE_BASE)
+        g_next_handle = REPLAY_HANDLE_BASE;
+
+    PendingSend &p = g_pending[handle];
+    p.key = exchange_key(server_key(server_ip, port), query, len);
+    p.query.assign(query, query + std::min(len, DNS_HEADER_LEN)); // only the ID is needed
+    p.sent_at = Clock::now();
+    return handle;
+}
+
+ssize_t transport_replay_recv(int handle, uint8_t *buf, size_t cap)
+{
+    RecordedReply reply;
+    uint8_t id[2] = {0, 0};
+    Clock::time_point sent_at;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        auto pit = g_pending.find(handle);
+        if (pit == g_pending.end())
+            return -1;
+        if (pit->second.query.size() >= 2)
+            std::memcpy(id, pit->second.query.data(), 2);
+        sent_at = pit->second.sent_at;
+
+        auto rit = g_replay.find(pit->second.key);
+        g_pending.erase(pit);
+        if (rit == g_replay.end() || rit->second.replies.empty())
+        {
+            std::cerr << "REPLAY: No recorded exchange for this query.\n";
+            return -1;
+        }
+
+        ReplayQueue &q = rit->second;
+        size_t idx = std::min(q.next, q.replies.size() - 1);
+        if (q.next < q.replies.size())
+            q.next++;
+        reply = q.replies[idx];
+    }
+
+    // Latency counts from the send, so overlapping queries overlap on replay too
+    if (!g_zero_latency && reply.latency_us > 0)
+        std::this_thread::sleep_until(sent_at + std::chrono::microseconds(reply.latency_us));
+
+    if (!reply.answered)
+    {
+        std::cerr << "TIMEOUT: No response received.\n";
+        return -1;
+    }
+
+    size_t n = std::min(cap, reply.response.size());
+    std::memcpy(buf, reply.response.data(), n);
+    if (n >= 2)
+        std::memcpy(buf, id, 2);
+    return static_cast<ssize_t>(n);
+}
+
+void transport_record_send(int sockfd, const uint8_t *query, size_t len, const char *server_ip, uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    PendingSend &p = g_pending[sockfd];
+    p.server = server_key(server_ip, port);
+    p.query.assign(query, query + len);
+    p.sent_at = Clock::now();
+}
+
+void transport_record_recv(int sockfd, const uint8_t *response, ssize_t len)
+{
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(g_mutex);
+    auto it = g_pending.find(sockfd);
+    if (it == g_pending.end())
+        return;
+    PendingSend p = std::move(it->second);
+    g_pending.erase(it);
+    if (!g_capture.is_open())
+        return;
+
+    uint64_t latency_us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - p.sent_at).count());
+
+    put_raw(g_capture, static_cast<uint16_t>(p.server.size()));
+    g_capture.write(p.server.data(), p.server.size());
+    put_raw(g_capture, static_cast<uint16_t>(p.query.size()));
+    g_capture.write(reinterpret_cast<const char *>(p.query.data()), p.query.size());
+    put_raw(g_capture, static_cast<int32_t>(len < 0 ? -1 : len));
+    if (len > 0)
+        g_capture.write(reinterpret_cast<const char *>(response), len);
+    put_raw(g_capture, latency_us);
+    g_capture.flush(); // a killed run still leaves a usable capture
+}
@@ -10,11 +10,11 @@
 
 constexpr uint8_t DNS_LABEL_POINTER_MASK = 0xC0;
 
-std::vector<uint8_t> encode_domain(const std::string &domain)
+template <class Buf>
+static void append_encoded_domain(std::string_view domain, Buf &result)
 {
-    std::vector<uint8_t> result;
     size_t start = 0, end;
-    while ((end = domain.find('.', start)) != std::string::npos)
+    while ((end = domain.find('.', start)) != std::string_view::npos)
     {
         size_t len = end - start;
         result.push_back(static_cast<uint8_t>(len));
@@ -25,12 +25,28 @@ std::vector<uint8_t> encode_domain(const std::string &domain)
     result.push_back(static_cast<uint8_t>(len));
     result.insert(result.end(), domain.begin() + start, domain.end());
     result.push_back(0);
+}
+
+std::vector<uint8_t> encode_domain(const std::string &domain)
+{
+    std::vector<uint8_t> result;
+    append_encoded_domain(domain, result);
     return result;
 }
 
-std::string decode_domain(const std::vector<uint8_t> &data, size_t &offset)
+void encode_domain(std::string_view domain, std::vector<uint8_t> &out)
+{
+    append_encoded_domain(domain, out);
+}
+
+void encode_domain(std::string_view domain, std::pmr::vector<uint8_t> &out)
+{
+    append_encoded_domain(domain, out);
+}
+
+template <class Str, class Buf>
+static void decode_domain_into(const Buf &data, size_t &offset, Str &result)
 {
-    std::string result;
     size_t orig_offset = offset;
     bool jumped = false;
 
@@ -58,7 +74,19 @@ std::string decode_domain(const std::vector<uint8_t> &data, size_t &offset)
         result.pop_back();
     if (jumped)
         offset = orig_offset;
+}
 
+std::string decode_domain(const std::vector<uint8_t> &data, size_t &offset)
+{
+    std::string result;
+    decode_domain_into(data, offset, result);
+    return result;
+}
+
+std::pmr::string decode_domain(const std::pmr::vector<uint8_t> &data, size_t &offset)
+{
+    std::pmr::string result(data.get_allocator().resource());
+    decode_domain_into(data, offset, result);
     return result;
 }
 
@@ -103,20 +131,29 @@ void dump_packet(std::vector<uint8_t> &data)
     }
 }
 
-uint16_t read_u16(const std::vector<uint8_t> &buf, size_t pos)
+template <class Buf>
+static uint16_t load_u16(const Buf &buf, size_t pos)
 {
     return static_cast<uint16_t>((buf[pos] << 8) | buf[pos + 1]);
 }
-uint32_t read_u32(const std::vector<uint8_t> &buf, size_t pos)
+
+template <class Buf>
+static uint32_t load_u32(const Buf &buf, size_t pos)
 {
     return (static_cast<uint32_t>(buf[pos]) << 24) |
            (static_cast<uint32_t>(buf[pos + 1]) << 16) |
            (static_cast<uint32_t>(buf[pos + 2]) << 8) |
            (static_cast<uint32_t>(buf[pos + 3]));
 }
+
+uint16_t read_u16(const std::vector<uint8_t> &buf, size_t pos) { return load_u16(buf, pos); }
+uint32_t read_u32(const std::vector<uint8_t> &buf, size_t pos) { return load_u32(buf, pos); }
 uint16_t read16(const std::vector<uint8_t> &buf, size_t pos) { return read_u16(buf, pos); }
+uint16_t read_u16(const std::pmr::vector<uint8_t> &buf, size_t pos) { return load_u16(buf, pos); }
+uint32_t read_u32(const std::pmr::vector<uint8_t> &buf, size_t pos) { return load_u32(buf, pos); }
 
-void skip_rr(const std::vector<uint8_t> &buf, size_t &off)
+template <class Buf>
+static void skip_rr_in(const Buf &buf, size_t &off)
 {
     // Skip owner name (labels/pointers) until 0
     while (buf[off] != 0)
@@ -132,10 +169,13 @@ void skip_rr(const std::vector<uint8_t> &buf, size_t &off)
         off += 1; // null root
 
     off += 2 /*type*/ + 2 /*class*/ + 4 /*ttl*/;
-    uint16_t rdlength = read_u16(buf, off);
+    uint16_t rdlength = load_u16(buf, off);
     off += 2 + rdlength;
 }
 
+void skip_rr(const std::vector<uint8_t> &buf, size_t &off) { skip_rr_in(buf, off); }
+void skip_rr(const std::pmr::vector<uint8_t> &buf, size_t &off) { skip_rr_in(buf, off); }
+
 bool is_ip_literal(const std::string &s)
 {
     return s.find('.') != std::string::npos || s.find(':') != std::string::npos;
@@ -0,0 +1,513 @@
+#include "dnsresolver.h"
+#include "cache_snapshot.h"
+#include "cname_cache.h"
+#include "flood_guard.h"
+#include "hot_cache.h"
+#include "mpsc_queue.h"
+#include "resolver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace
+{
+    // Per-thread L1 shared by every DnsResolver on the thread; slots are
+    // tagged with the owning resolver's id. Hit counts are kept locally and
+    // published in chunks so L1 hits do not write shared cache lines.
+    constexpr size_t L1_SLOTS = 1024;
+    constexpr uint64_t L1_STATS_FLUSH = 1024;
+
+    using HitCounter = std::shared_ptr<std::atomic<uint64_t>>;
+
+    struct ThreadL1
+    {
+        HotCache<std::vector<std::string>, L1_SLOTS> cache;
+        uint64_t pending_hits = 0;
+        HitCounter hits_sink; // keeps a destroyed resolver's counter valid
+
+        ~ThreadL1() { flush(); } // a thread that exits still counts its last hits
+
+        void count_hit(const HitCounter &sink)
+        {
+            if (hits_sink != sink)
+            {
+                flush();
+                hits_sink = sink;
+            }
+            if (++pending_hits == L1_STATS_FLUSH)
+                flush();
+        }
+
+        void flush()
+        {
+            if (hits_sink && pending_hits)
+                hits_sink->fetch_add(pending_hits, std::memory_order_relaxed);
+            pending_hits = 0;
+        }
+    };
+    thread_local ThreadL1 t_l1;
+
+    std::atomic<uint64_t> g_next_resolver_id{1};
+
+    struct PendingBatch
+    {
+        DnsBatch batch;
+        std::atomic<size_t> remaining{0};
+        DnsResolver::BatchCallback done; // empty: queue + eventfd
+    };
+
+    struct Job
+    {
+        std::shared_ptr<PendingBatch> pending;
+        size_t index;
+    };
+
+    // One per miss worker. submit() deals misses out round-robin; a worker
+    // takes the oldest job from its own deque and, when that is empty, steals
+    // the oldest from another, so jobs queued behind a miss that is stuck
+    // waiting on a slow upstream are picked up by whoever is free.
+    struct alignas(64) WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+}
+
+struct DnsResolver::Impl
+{
+    explicit Impl(const DnsResolverOptions &opts)
+        : cache(opts.cache_bytes ? opts.cache_bytes : opts.cache_entries,
+                opts.tinylfu ? CachePolicy::WTinyLfu : CachePolicy::Lru,
+                opts.cache_bytes ? CacheLimit::Bytes : CacheLimit::Entries),
+          use_l1(opts.hot_cache)
+    {
+        if (opts.flood_guard)
+            flood_guard.reset(new FloodGuard());
+    }
+
+    // L1 (this thread's hot slots) first, then the shared L2 under its lock;
+    // L2 hits are copied into L1 with the generation read under that lock.
+    // A name answered through cached CNAME links lands in L1 flattened.
+    bool cache_get(DnsAnswer &a)
+    {
+        uint32_t ttl_left = 0;
+        size_t hash = 0;
+        if (use_l1)
+        {
+            hash = HotCache<std::vector<std::string>>::hash_of(a.name, a.qtype);
+            uint64_t gen = generation.load(std::memory_order_acquire);
+            if (t_l1.cache.get(id, gen, a.name, a.qtype, hash, a.answers, ttl_left))
+            {
+                t_l1.count_hit(l1_hits);
+                return fill_hit(a, ttl_left);
+            }
+        }
+
+        uint64_t gen;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            ChainLookup look;
+            if (!l2_get(a, look))
+            {
+                l2_misses++;
+                return false;
+            }
+            l2_hits++;
+            ttl_left = look.ttl;
+            gen = generation.load(std::memory_order_relaxed);
+        }
+        if (use_l1)
+            t_l1.cache.put(id, gen, a.name, a.qtype, hash, a.answers, ttl_left);
+        return fill_hit(a, ttl_left);
+    }
+
+    // Follows cached CNAME links; caller holds cache_mutex
+    bool l2_get(DnsAnswer &a, ChainLookup &look)
+    {
+        auto get = [this](const std::string &key, std::vector<std::string> &out, uint32_t &ttl_left, bool probe)
+        { return cache.get(key, out, ttl_left, probe); };
+        return chain_get(a.name, a.qtype, get, a.answers, look);
+    }
+
+    // Where resolving has to start: the first link not in the cache (the
+    // name itself unless part of its chain is cached). False if another
+    // lookup has filled the whole chain in the meantime.
+    bool find_tail(DnsAnswer &a, ChainLookup &look)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (l2_get(a, look))
+        {
+            fill_hit(a, look.ttl);
+            return false;
+        }
+        return true;
+    }
+
+    static bool fill_hit(DnsAnswer &a, uint32_t ttl_left)
+    {
+        a.ttl = ttl_left;
+        a.nxdomain = a.answers.empty(); // only NXDOMAIN is cached without answers
+        a.cached = true;
+        return true;
+    }
+
+    // Under a zone being flooded with random names, a name not known to
+    // exist gets NXDOMAIN here; it is not cached, the names never repeat
+    bool shed_miss(DnsAnswer &a)
+    {
+        if (!flood_guard || !flood_guard->should_shed(a.name))
+            return false;
+        a.answers.clear();
+        a.nxdomain = true;
+        a.ttl = SHED_TTL;
+        a.shed = true;
+        return true;
+    }
+
+    void resolve_miss(DnsAnswer &a)
+    {
+        ChainLookup look;
+        if (find_tail(a, look))
+            store(a, look, resolve_with_ttl(look.tail, a.qtype));
+    }
+
+    // A and AAAA as separate cache entries; only the missing families go
+    // upstream, and when both are missing they are queried together.
+    void resolve_addresses(DnsAnswer &a, DnsAnswer &aaaa)
+    {
+        bool have_a = cache_get(a) || shed_miss(a);
+        bool have_aaaa = cache_get(aaaa) || shed_miss(aaaa);
+        ChainLookup look_a, look_aaaa;
+        if (!have_a && !have_aaaa && find_tail(a, look_a) && find_tail(aaaa, look_aaaa) &&
+            look_a.tail == look_aaaa.tail)
+        {
+            DualStackResult res = resolve_dual_stack_with_ttl(look_a.tail);
+            store(a, look_a, std::move(res.a));
+            store(aaaa, look_aaaa, std::move(res.aaaa));
+            return;
+        }
+        if (!have_a)
+            resolve_miss(a);
+        if (!have_aaaa)
+            resolve_miss(aaaa);
+    }
+
+    // Same TTL policy as the CLI: every CNAME link and the final RRset are
+    // cached with their own TTLs; the answer gets the shortest along the chain
+    void store(DnsAnswer &a, const ChainLookup &look, DnsResult res)
+    {
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            bool replaced = false;
+            chain_put(look.tail, a.qtype, res,
+                      [&](const std::string &key, const std::vector<std::string> &val, uint32_t ttl)
+                      {
+                          CachePut r = cache.put(key, val, ttl);
+                          replaced |= r == CachePut::Replaced; // not Refreshed: L1 copies still match
+                          l2_rejected += r == CachePut::Rejected;
+                      });
+            if (replaced)
+                generation.fetch_add(1, std::memory_order_release); // L1 copies may be stale
+        }
+        if (flood_guard)
+            flood_guard->observe(a.name, !res.answers.empty() || res.nodata, res.nxdomain);
+        a.ttl = chain_answer_ttl(look, res);
+        a.answers = std::move(res.answers);
+        a.nxdomain = res.nxdomain;
+    }
+
+    void finish(std::shared_ptr<PendingBatch> &p)
+    {
+        if (p->done)
+        {
+            p->done(p->batch);
+            return;
+        }
+        completed.push(std::move(p->batch));
+
+        // One eventfd write per wakeup of the consumer, not per batch
+        uint64_t one = 1;
+        if (event_fd >= 0 && !wake_pending.exchange(true) && write(event_fd, &one, sizeof(one)) < 0)
+            std::cerr << "Failed to signal batch completion: " << std::strerror(errno) << "\n";
+    }
+
+    // `missed`: the caller has just looked every query up and missed, so
+    // the cache is not asked (nor the miss counted) a second time
+    uint64_t submit(std::vector<DnsQuery> &queries, BatchCallback done, bool missed = false)
+    {
+        auto p = std::make_shared<PendingBatch>();
+        p->batch.id = next_id.fetch_add(1, std::memory_order_relaxed);
+        p->done = std::move(done);
+        p->batch.results.resize(queries.size());
+
+        std::vector<size_t> misses;
+        for (size_t i = 0; i < queries.size(); ++i)
+        {
+            DnsAnswer &a = p->batch.results[i];
+            a.name = std::move(queries[i].name);
+            a.qtype = queries[i].qtype;
+            if ((missed || !cache_get(a)) && !shed_miss(a))
+                misses.push_back(i);
+        }
+
+        uint64_t id = p->batch.id;
+        if (misses.empty())
+        {
+            finish(p);
+            return id;
+        }
+
+        p->remaining.store(misses.size(), std::memory_order_relaxed);
+        queued.fetch_add(misses.size()); // first, so it never drops below 0
+        for (size_t i : misses)
+        {
+            WorkerQueue &q = *queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.jobs.push_back(Job{p, i});
+        }
+
+        // Workers announce themselves in `sleeping` before they re-check
+        // `queued`, so either they see these jobs or we see them asleep
+        if (sleeping.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+            }
+            if (misses.size() == 1)
+                idle_cv.notify_one();
+            else
+                idle_cv.notify_all();
+        }
+        return id;
+    }
+
+    // Own deque first, then the others starting with the next one
+    bool take_job(size_t self, Job &job)
+    {
+        for (size_t k = 0; k < queues.size(); ++k)
+        {
+            WorkerQueue &q = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.jobs.empty())
+                continue;
+            job = std::move(q.jobs.front());
+            q.jobs.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void worker_loop(size_t self)
+    {
+        for (;;)
+        {
+            Job job;
+            if (!take_job(self, job))
+            {
+                std::unique_lock<std::mutex> lock(idle_mutex);
+                sleeping.fetch_add(1);
+                idle_cv.wait(lock, [this]
+                             { return stopping || queued.load() > 0; });
+                sleeping.fetch_sub(1);
+                if (stopping && queued.load() == 0)
+                    return; // stopping and drained
+                continue;
+            }
+
+            resolve_miss(job.pending->batch.results[job.index]);
+            if (job.pending->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                finish(job.pending);
+        }
+    }
+
+    DnsAnswerCache cache;
+    mutable std::mutex cache_mutex;
+    size_t l2_hits = 0, l2_misses = 0; // per lookup, under cache_mutex
+    size_t l2_rejected = 0;            // entries too big to cache, under cache_mutex
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues; // one per worker
+    std::atomic<size_t> next_queue{0};
+    std::atomic<size_t> queued{0}; // jobs in all deques
+    std::atomic<unsigned> sleeping{0};
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    bool stopping = false; // under idle_mutex
+    std::vector<std::thread> workers;
+
+    int event_fd = -1;
+    MpscQueue<DnsBatch> completed; // workers push, take_completed() pops
+    std::atomic<bool> wake_pending{false};
+    std::mutex take_mutex; // take_completed() callers, one at a time
+
+    std::atomic<uint64_t> next_id{1};
+
+    const uint64_t id = g_next_resolver_id.fetch_add(1, std::memory_order_relaxed);
+    bool use_l1;
+    std::atomic<uint64_t> generation{0};
+    HitCounter l1_hits = std::make_shared<std::atomic<uint64_t>>(0);
+
+    static constexpr uint32_t SHED_TTL = 5;
+    std::unique_ptr<FloodGuard> flood_guard;
+};
+
+DnsResolver::DnsResolver(const DnsResolverOptions &opts)
+    : impl_(new Impl(opts))
+{
+    impl_->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (impl_->event_fd < 0)
+        std::cerr << "eventfd failed: " << std::strerror(errno) << "\n";
+
+    unsigned n = std::max(1u, opts.workers);
+    impl_->workers.reserve(n);
+    for (unsigned i = 0; i < n; ++i)
+        impl_->queues.emplace_back(new WorkerQueue);
+    for (unsigned i = 0; i < n; ++i)
+        impl_->workers.emplace_back([this, i]
+                                    { impl_->worker_loop(i); });
+}
+
+DnsResolver::~DnsResolver()
+{
+    {
+        std::lock_guard<std::mutex> lock(impl_->idle_mutex);
+        impl_->stopping = true;
+    }
+    impl_->idle_cv.notify_all();
+    for (auto &t : impl_->workers)
+        t.join();
+    if (impl_->event_fd >= 0)
+        close(impl_->event_fd);
+}
+
+DnsAnswer DnsResolver::resolve(const std::string &name, uint16_t qtype)
+{
+    DnsAnswer a;
+    a.name = name;
+    a.qtype = qtype;
+    if (!impl_->cache_get(a) && !impl_->shed_miss(a))
+        impl_->resolve_miss(a);
+    return a;
+}
+
+DnsAddresses DnsResolver::resolve_addresses(const std::string &name)
+{
+    DnsAddresses out;
+    out.a.name = name;
+    out.a.qtype = 1;
+    out.aaaa.name = name;
+    out.aaaa.qtype = 28;
+    impl_->resolve_addresses(out.a, out.aaaa);
+    return out;
+}
+
+bool DnsResolver::lookup_cached(const std::string &name, uint16_t qtype, DnsAnswer &out)
+{
+    out.name = name;
+    out.qtype = qtype;
+    out.cached = false;
+    return impl_->cache_get(out);
+}
+
+uint64_t DnsResolver::submit(std::vector<DnsQuery> queries, BatchCallback done)
+{
+    return impl_->submit(queries, std::move(done));
+}
+
+uint64_t DnsResolver::submit_missed(std::vector<DnsQuery> queries, BatchCallback done)
+{
+    return impl_->submit(queries, std::move(done), true);
+}
+
+uint64_t DnsResolver::submit(std::vector<DnsQuery> queries)
+{
+    return impl_->submit(queries, nullptr);
+}
+
+int DnsResolver::completion_fd() const
+{
+    return impl_->event_fd;
+}
+
+size_t DnsResolver::take_completed(std::vector<DnsBatch> &out)
+{
+    std::lock_guard<std::mutex> lock(impl_->take_mutex);
+    uint64_t count = 0;
+    if (impl_->event_fd >= 0)
+        (void)!read(impl_->event_fd, &count, sizeof(count)); // reset; EAGAIN if nothing new
+    impl_->wake_pending.exchange(false); // before draining: a later finish() signals again
+
+    size_t n = 0;
+    DnsBatch batch;
+    while (impl_->completed.pop(batch))
+    {
+        out.push_back(std::move(batch));
+        n++;
+    }
+    return n;
+}
+
+size_t DnsResolver::l1_hits() const
+{
+    if (t_l1.hits_sink == impl_->l1_hits)
+        t_l1.flush(); // include this thread's unpublished hits
+    return impl_->l1_hits->load(std::memory_order_relaxed);
+}
+
+size_t DnsResolver::cache_hits() const
+{
+    std::lock_guard<std::mutex> lock(impl_->cache_mutex);
+    return impl_->l2_hits;
+}
+
+size_t DnsResolver::cache_misses() const
+{
+    std::lock_guard<std::mutex> lock(impl_->cache_mutex);
+    return impl_->l2_misses;
+}
+
+size_t DnsResolver::cache_rejected() const
+{
+    std::lock_guard<std::mutex> lock(impl_->cache_mutex);
+    return impl_->l2_rejected;
+}
+
+size_t DnsResolver::cache_size() const
+{
+    std::lock_guard<std::mutex> lock(impl_->cache_mutex);
+    return impl_->cache.size();
+}
+
+bool DnsResolver::load_snapshot(const std::string &path, size_t *loaded)
+{
+    std::lock_guard<std::mutex> lock(impl_->cache_mutex);
+    bool ok = load_cache_snapshot(impl_->cache, path, loaded);
+    impl_->generation.fetch_add(1, std::memory_order_release); // L1 copies may be stale
+    return ok;
+}
+
+bool DnsResolver::save_snapshot(const std::string &path) const
+{
+    std::lock_guard<std::mutex> lock(impl_->cache_mutex);
+    return save_cache_snapshot(impl_->cache, path);
+}
+
+DnsFloodStats DnsResolver::flood_stats() const
+{
+    DnsFloodStats out;
+    if (!impl_->flood_guard)
+        return out;
+    FloodGuardStats st = impl_->flood_guard->stats();
+    out.shed = st.shed;
+    out.probes = st.probes;
+    out.triggers = st.triggers;
+    return out;
+}
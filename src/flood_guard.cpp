@@ -0,0 +1,224 @@
+#include "flood_guard.h"
+
+#include <algorithm>
+#include <cstring>
+
+static inline uint8_t lower(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+// FNV-1a over the case-folded name; never 0, which marks a free zone slot
+static uint64_t name_hash(std::string_view name)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : name)
+    {
+        h ^= lower(static_cast<uint8_t>(c));
+        h *= 0x100000001b3ULL;
+    }
+    return h | 1;
+}
+
+// splitmix64 finalizer: independent bits for the positions inside a block
+static uint64_t remix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// The registrable domain: the last two labels, or the last three under a
+// two-letter TLD with a generic second level (co.uk, com.au). Recursive
+// upstreams hand back no referral, so a fixed suffix depth stands in for the
+// delegation point and <rand>.<rand>.victim.example still lands on one zone.
+// A flood under a TLD is not told apart from ordinary traffic.
+static std::string_view zone_of(std::string_view name)
+{
+    if (!name.empty() && name.back() == '.')
+        name.remove_suffix(1);
+    size_t last = name.rfind('.');
+    if (last == std::string_view::npos || last == 0)
+        return {};
+    size_t start = name.rfind('.', last - 1);
+    static constexpr std::string_view generic[] = {"ac", "co", "com", "edu", "gov", "ne", "net", "or", "org"};
+    std::string_view second = name.substr(start + 1, last - (start + 1));
+    if (name.size() - last - 1 == 2 && std::find(std::begin(generic), std::end(generic), second) != std::end(generic))
+    {
+        if (start == std::string_view::npos || start == 0)
+            return {}; // the name is the public suffix itself
+        start = name.rfind('.', start - 1);
+    }
+    return start == std::string_view::npos ? name : name.substr(start + 1);
+}
+
+// ---- BlockedBloomFilter ----------------------------------------------------
+
+constexpr int BLOOM_PROBES = 7; // 7 x 9-bit positions from one 64-bit hash
+
+BlockedBloomFilter::BlockedBloomFilter(size_t bytes)
+    : blocks_(std::max<size_t>(1, bytes / sizeof(Block)))
+{
+    clear();
+}
+
+void BlockedBloomFilter::insert(uint64_t hash)
+{
+    Block &b = blocks_[static_cast<size_t>((static_cast<unsigned __int128>(hash) * blocks_.size()) >> 64)];
+    uint64_t bits = remix(hash);
+    for (int i = 0; i < BLOOM_PROBES; ++i, bits >>= 9)
+        b.words[(bits & 511) >> 6] |= 1ULL << (bits & 63);
+}
+
+bool BlockedBloomFilter::may_contain(uint64_t hash) const
+{
+    const Block &b = blocks_[static_cast<size_t>((static_cast<unsigned __int128>(hash) * blocks_.size()) >> 64)];
+    uint64_t bits = remix(hash);
+    for (int i = 0; i < BLOOM_PROBES; ++i, bits >>= 9)
+    {
+        if (!(b.words[(bits & 511) >> 6] & (1ULL << (bits & 63))))
+            return false;
+    }
+    return true;
+}
+
+void BlockedBloomFilter::clear()
+{
+    std::memset(blocks_.data(), 0, blocks_.size() * sizeof(Block));
+}
+
+// ---- FloodGuard ------------------------------------------------------------
+
+FloodGuard::FloodGuard(const FloodGuardOptions &opts)
+    : opts_(opts), zones_(ZONE_SLOTS), current_(opts.filter_bytes), previous_(opts.filter_bytes),
+      start_(std::chrono::steady_clock::now())
+{
+    opts_.window_sec = std::max<uint32_t>(1, opts_.window_sec);
+}
+
+// Seconds since construction, from 1 so that 0 can mean "never"
+uint32_t FloodGuard::now_sec() const
+{
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count()) + 1;
+}
+
+bool FloodGuard::known(uint64_t name_hash) const
+{
+    return current_.may_contain(name_hash) || previous_.may_contain(name_hash);
+}
+
+// Counters halve for every window that has passed
+void FloodGuard::age(ZoneSlot &z, uint32_t now) const
+{
+    uint32_t windows = (now - z.window_start) / opts_.window_sec;
+    if (windows == 0)
+        return;
+    uint32_t shift = std::min<uint32_t>(windows, 31);
+    z.lookups >>= shift;
+    z.nxdomains >>= shift;
+    z.window_start += windows * opts_.window_sec;
+}
+
+bool FloodGuard::should_shed(std::string_view name)
+{
+    std::string_view zone = zone_of(name);
+    if (zone.empty())
+        return false;
+    uint64_t tag = name_hash(zone);
+    uint64_t h = name_hash(name);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ZoneSlot &z = zones_[tag % ZONE_SLOTS];
+    uint32_t now = now_sec();
+    if (z.tag != tag || z.defended_until <= now || known(h))
+        return false;
+
+    // A few unknown names still go upstream: new names can get in, and the
+    // zone's NXDOMAIN share keeps being measured
+    if (z.probe_second != now)
+    {
+        z.probe_second = now;
+        z.probes = 0;
+    }
+    if (z.probes < opts_.probes_per_sec)
+    {
+        z.probes++;
+        stats_.probes++;
+        return false;
+    }
+    stats_.shed++;
+    count(z, now, true);
+    return true;
+}
+
+void FloodGuard::observe(std::string_view name, bool exists, bool nxdomain)
+{
+    std::string_view zone = zone_of(name);
+    uint64_t h = name_hash(name);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (exists && !known(h))
+    {
+        if (current_names_ >= current_.capacity())
+        {
+            std::swap(current_, previous_); // oldest generation goes
+            current_.clear();
+            current_names_ = 0;
+        }
+        current_.insert(h);
+        current_names_++;
+    }
+    if (zone.empty())
+        return;
+
+    uint64_t tag = name_hash(zone);
+    ZoneSlot &z = zones_[tag % ZONE_SLOTS];
+    uint32_t now = now_sec();
+    if (z.tag != tag)
+    {
+        // Another zone holds the slot. A busy one wears down one lookup per
+        // collision, so a flooded zone takes the slot quickly; a defended one
+        // keeps it until its defence ends.
+        if (z.tag != 0)
+        {
+            age(z, now);
+            if (z.defended_until > now || z.lookups > 1)
+            {
+                if (z.defended_until <= now)
+                {
+                    z.lookups--;
+                    z.nxdomains = std::min(z.nxdomains, z.lookups);
+                }
+                return;
+            }
+        }
+        z = ZoneSlot{};
+        z.tag = tag;
+        z.window_start = now;
+    }
+
+    count(z, now, nxdomain);
+}
+
+void FloodGuard::count(ZoneSlot &z, uint32_t now, bool nxdomain)
+{
+    age(z, now);
+    z.lookups++;
+    if (nxdomain)
+        z.nxdomains++;
+    if (z.nxdomains >= opts_.min_nxdomain && z.nxdomains >= opts_.nxdomain_share * z.lookups)
+    {
+        if (z.defended_until <= now)
+            stats_.triggers++;
+        z.defended_until = now + opts_.hold_sec;
+    }
+}
+
+FloodGuardStats FloodGuard::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,525 @@
+#include "local_zone.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <utility>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---- hashing ---------------------------------------------------------------
+
+static inline uint8_t lower(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+// FNV-1a over the lower-cased name followed by the qtype.
+static uint64_t zone_key_hash(std::string_view name, uint16_t qtype, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    for (char c : name)
+    {
+        h ^= lower(static_cast<uint8_t>(c));
+        h *= 0x100000001b3ULL;
+    }
+    h ^= qtype;
+    h *= 0x100000001b3ULL;
+    return h;
+}
+
+static inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline uint32_t zone_bucket(uint64_t h, uint32_t bucket_count)
+{
+    return static_cast<uint32_t>(mix64(h) % bucket_count);
+}
+
+static inline uint32_t zone_slot(uint64_t h, uint32_t disp, uint32_t n)
+{
+    return static_cast<uint32_t>(mix64(h ^ ((disp + 1) * 0x9E3779B97F4A7C15ULL)) % n);
+}
+
+static std::string_view strip_root_dot(std::string_view name)
+{
+    if (!name.empty() && name.back() == '.')
+        name.remove_suffix(1);
+    return name;
+}
+
+// ---- reader ----------------------------------------------------------------
+
+LocalZone::~LocalZone() { close(); }
+
+void LocalZone::close()
+{
+    if (base_)
+        munmap(const_cast<uint8_t *>(base_), len_);
+    base_ = nullptr;
+    len_ = 0;
+    hdr_ = nullptr;
+    disp_ = nullptr;
+    slots_ = nullptr;
+    pool_ = nullptr;
+}
+
+static bool slot_in_pool(const ZoneSlot &slot, const uint8_t *pool, size_t pool_len)
+{
+    if (uint64_t(slot.name_off) + slot.name_len > pool_len)
+        return false;
+    size_t p = slot.answers_off;
+    for (uint16_t i = 0; i < slot.answer_count; ++i)
+    {
+        if (p >= pool_len)
+            return false;
+        p += 1 + pool[p]; // [u8 len][bytes]
+    }
+    return p <= pool_len;
+}
+
+bool LocalZone::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot open zone image " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(ZoneImageHeader))
+    {
+        std::cerr << "Zone image " << path << " is truncated.\n";
+        ::close(fd);
+        return false;
+    }
+
+    size_t len = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Cannot mmap zone image " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    const auto *hdr = static_cast<const ZoneImageHeader *>(map);
+    bool ok = std::memcmp(hdr->magic, ZONE_IMAGE_MAGIC, sizeof(hdr->magic)) == 0 &&
+              hdr->version == ZONE_IMAGE_VERSION &&
+              hdr->file_size == len &&
+              hdr->disp_off <= hdr->slots_off && hdr->slots_off <= hdr->pool_off &&
+              hdr->disp_off + uint64_t(hdr->bucket_count) * sizeof(uint32_t) <= hdr->slots_off &&
+              hdr->slots_off + uint64_t(hdr->record_count) * sizeof(ZoneSlot) <= hdr->pool_off &&
+              hdr->pool_off <= len &&
+              (hdr->record_count == 0 || hdr->bucket_count != 0);
+    if (!ok)
+    {
+        std::cerr << "Zone image " << path << " has a bad header or version.\n";
+        munmap(map, len);
+        return false;
+    }
+
+    // Lookups hit pages at random; don't bother with readahead.
+    madvise(map, len, MADV_RANDOM);
+
+    base_ = static_cast<const uint8_t *>(map);
+    len_ = len;
+    hdr_ = hdr;
+    disp_ = reinterpret_cast<const uint32_t *>(base_ + hdr->disp_off);
+    slots_ = reinterpret_cast<const ZoneSlot *>(base_ + hdr->slots_off);
+    pool_ = base_ + hdr->pool_off;
+    return true;
+}
+
+bool LocalZone::lookup(std::string_view name, uint16_t qtype, ZoneAnswers &out) const
+{
+    if (!hdr_ || hdr_->record_count == 0)
+        return false;
+
+    name = strip_root_dot(name);
+    uint64_t h = zone_key_hash(name, qtype, hdr_->seed);
+    uint32_t disp = disp_[zone_bucket(h, hdr_->bucket_count)];
+    const ZoneSlot &slot = slots_[zone_slot(h, disp, hdr_->record_count)];
+
+    // The hash is perfect only over stored keys; confirm the probe. The slot
+    // comes from the file, so its name and answers are bounds-checked here
+    // rather than all at open(), which would fault in the whole image.
+    if (slot.qtype != qtype || slot.name_len != name.size() ||
+        !slot_in_pool(slot, pool_, len_ - hdr_->pool_off))
+        return false;
+    const uint8_t *stored = pool_ + slot.name_off;
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        if (stored[i] != lower(static_cast<uint8_t>(name[i])))
+            return false;
+    }
+
+    out = ZoneAnswers(pool_ + slot.answers_off, slot.answer_count, slot.ttl);
+    return true;
+}
+
+// ---- source parsing --------------------------------------------------------
+
+static std::string normalise_name(std::string_view name)
+{
+    name = strip_root_dot(name);
+    std::string out(name);
+    for (char &c : out)
+        c = static_cast<char>(lower(static_cast<uint8_t>(c)));
+    return out;
+}
+
+static bool parse_ip(const std::string &s, uint16_t &qtype)
+{
+    uint8_t buf[16];
+    if (inet_pton(AF_INET, s.c_str(), buf) == 1)
+    {
+        qtype = 1;
+        return true;
+    }
+    if (inet_pton(AF_INET6, s.c_str(), buf) == 1)
+    {
+        qtype = 28;
+        return true;
+    }
+    return false;
+}
+
+static bool all_digits(const std::string &s)
+{
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](unsigned char c)
+                                     { return std::isdigit(c); });
+}
+
+bool parse_zone_ttl(const std::string &s, uint32_t &out)
+{
+    if (!all_digits(s))
+        return false;
+    errno = 0;
+    char *end = nullptr;
+    unsigned long v = std::strtoul(s.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || v > UINT32_MAX)
+        return false;
+    out = static_cast<uint32_t>(v);
+    return true;
+}
+
+// Applies $ORIGIN to relative owner/target names.
+static std::string qualify(const std::string &name, const std::string &origin)
+{
+    if (name == "@")
+        return origin;
+    if (!name.empty() && name.back() == '.')
+        return name;
+    if (origin.empty())
+        return name;
+    return name + "." + origin;
+}
+
+bool parse_zone_source(const std::string &path, uint32_t default_ttl,
+                       std::vector<ZoneRecord> &out)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "Cannot read " << path << "\n";
+        return false;
+    }
+
+    std::string origin;
+    std::string last_owner;
+    std::string line;
+    size_t lineno = 0;
+
+    while (std::getline(in, line))
+    {
+        ++lineno;
+        size_t cut = line.find_first_of("#;");
+        if (cut != std::string::npos)
+            line.erase(cut);
+
+        bool continues_owner = !line.empty() && (line[0] == ' ' || line[0] == '\t');
+        std::istringstream ss(line);
+        std::vector<std::string> tok;
+        for (std::string t; ss >> t;)
+            tok.push_back(std::move(t));
+        if (tok.empty())
+            continue;
+
+        if (tok[0] == "$TTL" && tok.size() >= 2)
+        {
+            if (!parse_zone_ttl(tok[1], default_ttl))
+            {
+                std::cerr << path << ":" << lineno << ": bad $TTL \"" << tok[1] << "\"\n";
+                return false;
+            }
+            continue;
+        }
+        if (tok[0] == "$ORIGIN" && tok.size() >= 2)
+        {
+            origin = std::string(strip_root_dot(tok[1]));
+            continue;
+        }
+
+        // hosts-style: IP name [alias...]
+        uint16_t ip_type = 0;
+        if (parse_ip(tok[0], ip_type))
+        {
+            for (size_t i = 1; i < tok.size(); ++i)
+                out.push_back(ZoneRecord{tok[i], ip_type, default_ttl, {tok[0]}});
+            continue;
+        }
+
+        // master-file style: [owner] [ttl] [IN] TYPE rdata...
+        size_t i = 0;
+        std::string owner;
+        if (continues_owner)
+            owner = last_owner;
+        else
+            owner = qualify(tok[i++], origin);
+        last_owner = owner;
+
+        uint32_t ttl = default_ttl;
+        while (i < tok.size() && (all_digits(tok[i]) || tok[i] == "IN"))
+        {
+            if (tok[i] != "IN" && !parse_zone_ttl(tok[i], ttl))
+            {
+                std::cerr << path << ":" << lineno << ": bad TTL \"" << tok[i] << "\"\n";
+                return false;
+            }
+            ++i;
+        }
+        if (i + 1 >= tok.size())
+        {
+            std::cerr << path << ":" << lineno << ": missing type or rdata, skipped\n";
+            continue;
+        }
+
+        const std::string &type = tok[i];
+        const std::string &rdata = tok[i + 1];
+        if (type == "A" || type == "AAAA")
+        {
+            uint16_t qtype = 0;
+            if (!parse_ip(rdata, qtype) || qtype != (type == "A" ? 1 : 28))
+            {
+                std::cerr << path << ":" << lineno << ": bad address \"" << rdata << "\", skipped\n";
+                continue;
+            }
+            out.push_back(ZoneRecord{owner, qtype, ttl, {rdata}});
+        }
+        else if (type == "CNAME")
+        {
+            out.push_back(ZoneRecord{owner, 5, ttl, {normalise_name(qualify(rdata, origin))}});
+        }
+        else if (type == "MX" && i + 2 < tok.size())
+        {
+            // CLI prints only the exchange, so that's all we keep
+            out.push_back(ZoneRecord{owner, 15, ttl, {normalise_name(qualify(tok[i + 2], origin))}});
+        }
+        else
+        {
+            std::cerr << path << ":" << lineno << ": unsupported record \"" << type << "\", skipped\n";
+        }
+    }
+    return true;
+}
+
+// ---- compiler --------------------------------------------------------------
+
+// Hash-and-displace: keys are grouped into buckets; largest buckets first, find
+// a displacement that sends every key of the bucket to a free slot.
+static bool build_perfect_hash(const std::vector<uint64_t> &hashes, uint32_t bucket_count,
+                               std::vector<uint32_t> &disp, std::vector<uint32_t> &slot_of)
+{
+    const uint32_t n = static_cast<uint32_t>(hashes.size());
+    std::vector<std::vector<uint32_t>> buckets(bucket_count);
+    for (uint32_t k = 0; k < n; ++k)
+        buckets[zone_bucket(hashes[k], bucket_count)].push_back(k);
+
+    std::vector<uint32_t> order(bucket_count);
+    for (uint32_t b = 0; b < bucket_count; ++b)
+        order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                     { return buckets[a].size() > buckets[b].size(); });
+
+    disp.assign(bucket_count, 0);
+    slot_of.assign(n, 0);
+    std::vector<bool> taken(n, false);
+    std::vector<uint32_t> tried;
+
+    constexpr uint32_t MAX_DISPLACEMENT = 1u << 24;
+    for (uint32_t b : order)
+    {
+        const auto &keys = buckets[b];
+        if (keys.empty())
+            break;
+
+        bool placed = false;
+        for (uint32_t d = 0; d < MAX_DISPLACEMENT && !placed; ++d)
+        {
+            tried.clear();
+            bool ok = true;
+            for (uint32_t k : keys)
+            {
+                uint32_t s = zone_slot(hashes[k], d, n);
+                if (taken[s] || std::find(tried.begin(), tried.end(), s) != tried.end())
+                {
+                    ok = false;
+                    break;
+                }
+                tried.push_back(s);
+            }
+            if (!ok)
+                continue;
+
+            for (size_t j = 0; j < keys.size(); ++j)
+            {
+                taken[tried[j]] = true;
+                slot_of[keys[j]] = tried[j];
+            }
+            disp[b] = d;
+            placed = true;
+        }
+        if (!placed)
+            return false;
+    }
+    return true;
+}
+
+bool compile_zone_image(std::vector<ZoneRecord> records, const std::string &out_path)
+{
+    // Merge (name, qtype) duplicates: union of answers, min TTL.
+    std::map<std::pair<std::string, uint16_t>, ZoneRecord> merged;
+    for (auto &r : records)
+    {
+        std::string name = normalise_name(r.name);
+        if (name.empty() || name.size() > 255)
+        {
+            std::cerr << "Skipping invalid name \"" << r.name << "\"\n";
+            continue;
+        }
+        auto key = std::make_pair(name, r.qtype);
+        auto it = merged.find(key);
+        if (it == merged.end())
+        {
+            r.name = std::move(name);
+            merged.emplace(std::move(key), std::move(r));
+            continue;
+        }
+        ZoneRecord &dst = it->second;
+        dst.ttl = std::min(dst.ttl, r.ttl);
+        for (auto &a : r.answers)
+        {
+            if (std::find(dst.answers.begin(), dst.answers.end(), a) == dst.answers.end())
+                dst.answers.push_back(std::move(a));
+        }
+    }
+    records.clear();
+
+    std::vector<const ZoneRecord *> recs;
+    recs.reserve(merged.size());
+    for (const auto &kv : merged)
+        recs.push_back(&kv.second);
+    const uint32_t n = static_cast<uint32_t>(recs.size());
+    const uint32_t bucket_count = std::max<uint32_t>(1, n / 4);
+
+    uint64_t seed = 0;
+    std::vector<uint64_t> hashes(n);
+    std::vector<uint32_t> disp, slot_of;
+    bool built = false;
+    for (int attempt = 0; attempt < 16 && !built; ++attempt)
+    {
+        seed = mix64(0x5a4f4e45ULL + attempt);
+        for (uint32_t k = 0; k < n; ++k)
+            hashes[k] = zone_key_hash(recs[k]->name, recs[k]->qtype, seed);
+        built = build_perfect_hash(hashes, bucket_count, disp, slot_of);
+    }
+    if (!built)
+    {
+        std::cerr << "Failed to build perfect hash for " << n << " records.\n";
+        return false;
+    }
+
+    // String pool and slots.
+    std::vector<uint8_t> pool;
+    std::vector<ZoneSlot> slots(n);
+    for (uint32_t k = 0; k < n; ++k)
+    {
+        const ZoneRecord &r = *recs[k];
+        ZoneSlot &s = slots[slot_of[k]];
+        s.name_off = static_cast<uint32_t>(pool.size());
+        s.name_len = static_cast<uint16_t>(r.name.size());
+        s.qtype = r.qtype;
+        s.ttl = r.ttl;
+        pool.insert(pool.end(), r.name.begin(), r.name.end());
+
+        s.answers_off = static_cast<uint32_t>(pool.size());
+        uint16_t count = 0;
+        for (const auto &a : r.answers)
+        {
+            if (a.size() > 255 || count == UINT16_MAX)
+                continue;
+            pool.push_back(static_cast<uint8_t>(a.size()));
+            pool.insert(pool.end(), a.begin(), a.end());
+            ++count;
+        }
+        s.answer_count = count;
+
+        if (pool.size() > UINT32_MAX)
+        {
+            std::cerr << "Zone image string pool exceeds 4 GiB.\n";
+            return false;
+        }
+    }
+
+    ZoneImageHeader hdr{};
+    std::memcpy(hdr.magic, ZONE_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = ZONE_IMAGE_VERSION;
+    hdr.record_count = n;
+    hdr.bucket_count = bucket_count;
+    hdr.seed = seed;
+    hdr.disp_off = sizeof(ZoneImageHeader);
+    hdr.slots_off = hdr.disp_off + uint64_t(bucket_count) * sizeof(uint32_t);
+    hdr.pool_off = hdr.slots_off + uint64_t(n) * sizeof(ZoneSlot);
+    hdr.file_size = hdr.pool_off + pool.size();
+
+    // Write to a temp file and rename so a running resolver never maps a half-written image.
+    std::string tmp = out_path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Cannot write " << tmp << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char *>(disp.data()), disp.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char *>(slots.data()), slots.size() * sizeof(ZoneSlot));
+    out.write(reinterpret_cast<const char *>(pool.data()), pool.size());
+    out.close();
+    if (!out || std::rename(tmp.c_str(), out_path.c_str()) != 0)
+    {
+        std::cerr << "Failed to write zone image " << out_path << "\n";
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
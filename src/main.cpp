@@ -8,16 +8,239 @@
 #include "dns_client.h"
 #include "dns_packet.h"
 #include "resolver.h"
+#include "resolve_trace.h"
+#include "cname_cache.h"
 #include "lru_ttl_cache.h"
+#include "local_zone.h"
+#include "blocklist.h"
+#include "shm_cache.h"
+#include "cache_snapshot.h"
+#include "dns_transport.h"
+#include "dns_dot.h"
+#include "dns_server.h"
+#include "dnsresolver.h"
+#include <csignal>
+
+#ifdef DNS_ALLOC_STATS
+#include <atomic>
+#include <new>
+
+// Counts every global heap allocation so --bench can report allocations per
+// miss. Built only with `make ALLOC_STATS=1`.
+static std::atomic<size_t> g_heap_allocs{0};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size)
+{
+    g_heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+#endif
 
 static void print_usage(const char *prog_name)
 {
     std::cout << "Usage:\n"
-              << "  " << prog_name << " <domain> [--type=A|AAAA|MX|CNAME] [--trace] [--show-ttl] [--bench=N]\n"
+              << "  " << prog_name << " <domain> [--type=A|AAAA|ADDR|MX|CNAME] [--trace[=hops]] [--trace-json=FILE]\n"
+              << "         [--show-ttl] [--bench=N]\n"
+              << "         [--zone=IMAGE] [--blocklist=IMAGE] [--block-mode=nxdomain|sinkhole]\n"
+              << "         [--shm-cache=NAME [--shm-cache-reset]] [--snapshot=FILE] [--cache-policy=lru|tinylfu]\n"
+              << "         [--cache-mem=SIZE[K|M|G]] [--record=FILE]\n"
+              << "         [--replay=FILE] [--replay-latency=recorded|zero]\n"
+              << "         [--dot] [--dot-port=N] [--dot-ca=FILE] [--dot-name=NAME] [--upstream=IP[:PORT],...]\n"
+              << "  " << prog_name << " --serve=PORT [--listen=IP] [--io=auto|uring|epoll]\n"
+              << "         [--zone=IMAGE] [--blocklist=IMAGE] [--cache-policy=...] [--cache-mem=SIZE]\n"
+              << "         [--flood-guard[=nxdomain|drop]] [--snapshot=FILE]\n"
               << "Examples:\n"
               << "  " << prog_name << " example.com\n"
               << "  " << prog_name << " example.com --type=AAAA --trace\n"
-              << "  " << prog_name << " example.com --bench=100\n";
+              << "  " << prog_name << " example.com --type=ADDR\n"
+              << "  " << prog_name << " www.example.com --trace=hops --trace-json=hops.json\n"
+              << "  " << prog_name << " example.com --bench=100\n"
+              << "  " << prog_name << " intranet.corp --zone=local.zimg\n"
+              << "  " << prog_name << " ads.example --blocklist=block.bimg --block-mode=sinkhole\n"
+              << "  " << prog_name << " example.com --shm-cache=/dns_resolver\n"
+              << "  " << prog_name << " example.com --bench=1000 --snapshot=cache.snap\n"
+              << "  " << prog_name << " example.com --record=example.cap\n"
+              << "  " << prog_name << " example.com --bench=100 --replay=example.cap --replay-latency=zero\n"
+              << "  " << prog_name << " example.com --bench=100 --dot --trace\n"
+              << "  " << prog_name << " --serve=5353 --zone=local.zimg --io=uring\n"
+              << "  " << prog_name << " --serve=5353 --flood-guard\n";
+}
+
+// SIGHUP asks the query loop to re-map the blocklist image
+static volatile std::sig_atomic_t g_reload_blocklist = 0;
+static void on_sighup(int) { g_reload_blocklist = 1; }
+
+// SIGINT/SIGTERM end the query loop so the cache snapshot is still written
+static volatile std::sig_atomic_t g_stop = 0;
+static void on_stop(int) { g_stop = 1; }
+
+constexpr int SNAPSHOT_INTERVAL_SEC = 60;
+
+// "256M" -> 268435456; returns 0 on malformed input
+static size_t parse_byte_size(const char *s)
+{
+    char *end = nullptr;
+    unsigned long long n = std::strtoull(s, &end, 10);
+    if (end == s)
+        return 0;
+    switch (*end)
+    {
+    case 'K': case 'k': n <<= 10; ++end; break;
+    case 'M': case 'm': n <<= 20; ++end; break;
+    case 'G': case 'g': n <<= 30; ++end; break;
+    default: break;
+    }
+    return *end == '\0' ? static_cast<size_t>(n) : 0;
+}
+
+// Replies that don't fit a plain UDP datagram go out empty with TC set
+static void build_server_reply(const uint8_t *query, size_t len, uint16_t qtype,
+                               const std::vector<std::string> &answers, uint32_t ttl,
+                               uint8_t rcode, std::vector<uint8_t> &out)
+{
+    constexpr size_t UDP_REPLY_MAX = 512;
+    build_response_packet(query, len, qtype, answers, ttl, rcode, out);
+    if (out.size() > UDP_REPLY_MAX)
+    {
+        build_response_packet(query, len, qtype, {}, 0, rcode, out);
+        out[2] |= 0x02; // TC
+    }
+}
+
+// DoT connection counters, printed when a run ends
+static void print_dot_stats()
+{
+    if (!dot_enabled())
+        return;
+    DotStats st = dot_stats();
+    std::cout << "DoT: queries=" << st.queries << " handshakes=" << st.handshakes
+              << " resumed=" << st.resumed << " max_pipelined=" << st.max_in_flight << "\n";
+}
+
+// Serve mode: answers client queries from the blocklist, the local zone and
+// the cache on the listener thread; misses are resolved on DnsResolver's
+// workers and answered through UdpServer::reply. Misses the flood guard
+// sheds get NXDOMAIN, or no reply at all with `flood_drop`.
+static int run_server(const ServerOptions &server_opts, const DnsResolverOptions &resolver_opts,
+                      BlocklistHandle &blocklist, const std::string &blocklist_path, bool sinkhole,
+                      const LocalZone &local_zone, bool flood_drop, const std::string &snapshot_path,
+                      bool trace)
+{
+    UdpServer server;
+    if (!server.open(server_opts))
+        return EXIT_FAILURE;
+    DnsResolver resolver(resolver_opts);
+
+    // Warm start as in the CLI: restored now, saved every interval and on exit
+    if (!snapshot_path.empty())
+    {
+        size_t restored = 0;
+        resolver.load_snapshot(snapshot_path, &restored);
+        log_info("Restored " + std::to_string(restored) + " cache entries from " + snapshot_path);
+    }
+    auto last_snapshot = std::chrono::steady_clock::now();
+
+    std::signal(SIGINT, on_stop);
+    std::signal(SIGTERM, on_stop);
+
+    std::string name;
+    std::vector<std::string> answers;
+    auto handler = [&](const uint8_t *query, size_t len, const sockaddr_in &from,
+                       std::vector<uint8_t> &response)
+    {
+        uint16_t qtype = 0;
+        if (!parse_query_question(query, len, name, qtype))
+            return false;
+
+        if (g_reload_blocklist)
+        {
+            g_reload_blocklist = 0;
+            if (blocklist.reload(blocklist_path))
+                log_info("Reloaded blocklist " + blocklist_path);
+        }
+
+        if (!snapshot_path.empty() &&
+            std::chrono::steady_clock::now() - last_snapshot >= std::chrono::seconds(SNAPSHOT_INTERVAL_SEC))
+        {
+            resolver.save_snapshot(snapshot_path);
+            last_snapshot = std::chrono::steady_clock::now();
+        }
+
+        answers.clear();
+        auto active_blocklist = blocklist.current();
+        if (active_blocklist && active_blocklist->blocked(name))
+        {
+            if (sinkhole && (qtype == 1 || qtype == 28))
+            {
+                answers.emplace_back(qtype == 1 ? "0.0.0.0" : "::");
+                build_server_reply(query, len, qtype, answers, 60, 0, response);
+            }
+            else
+                build_server_reply(query, len, qtype, answers, 60, 3, response);
+            return true;
+        }
+
+        ZoneAnswers zone_answers;
+        if (local_zone.loaded() && local_zone.lookup(name, qtype, zone_answers))
+        {
+            zone_answers.for_each([&](std::string_view a)
+                                  { answers.emplace_back(a); });
+            build_server_reply(query, len, qtype, answers, zone_answers.ttl(), 0, response);
+            return true;
+        }
+
+        DnsAnswer cached;
+        if (resolver.lookup_cached(name, qtype, cached))
+        {
+            build_server_reply(query, len, qtype, cached.answers, cached.ttl,
+                               cached.nxdomain ? 3 : 0, response);
+            return true;
+        }
+
+        if (trace)
+            std::cout << "[MISS] " << name << " type=" << qtype << "\n";
+        std::vector<uint8_t> query_copy(query, query + len);
+        resolver.submit_missed({DnsQuery{name, qtype}},
+                               [&server, from, flood_drop, query_copy = std::move(query_copy)](DnsBatch &batch)
+                               {
+                                   const DnsAnswer &a = batch.results.front();
+                                   if (a.shed && flood_drop)
+                                       return;
+                                   bool failed = a.answers.empty() && !a.nxdomain;
+                                   std::vector<uint8_t> reply;
+                                   build_server_reply(query_copy.data(), query_copy.size(), a.qtype, a.answers,
+                                                      a.ttl, failed ? 2 : (a.nxdomain ? 3 : 0), reply);
+                                   server.reply(from, std::move(reply));
+                               });
+        return false;
+    };
+
+    log_info("Serving on " + server_opts.listen_ip + ":" + std::to_string(server_opts.port));
+    bool ok = server.run(handler, g_stop);
+    if (!snapshot_path.empty() && resolver.save_snapshot(snapshot_path))
+        log_info("Saved " + std::to_string(resolver.cache_size()) + " cache entries to " + snapshot_path);
+    const ServerStats &st = server.stats();
+    std::cout << "Served with " << (server.backend() == ServerIo::IoUring ? "io_uring" : "epoll")
+              << ": received=" << st.received << " sent=" << st.sent << " dropped=" << st.dropped
+              << " syscalls=" << st.syscalls << "\n";
+    std::cout << "Cache stats: L1 hits=" << resolver.l1_hits() << " L2 hits=" << resolver.cache_hits()
+              << " misses=" << resolver.cache_misses() << " too_big=" << resolver.cache_rejected() << "\n";
+    if (resolver_opts.flood_guard)
+    {
+        DnsFloodStats fs = resolver.flood_stats();
+        std::cout << "Flood guard: shed=" << fs.shed << " probes=" << fs.probes
+                  << " zones_defended=" << fs.triggers << "\n";
+    }
+    print_dot_stats();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static uint16_t qtype_string_to_code(const std::string &qtype_str)
@@ -35,26 +258,51 @@ static uint16_t qtype_string_to_code(const std::string &qtype_str)
 
 int main(int argc, char *argv[])
 {
-    if (argc < 2 || argc > 5)
+    if (argc < 2)
     {
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    std::string domain = argv[1];
+    // Serve mode takes no domain: options start at argv[1]
+    bool serve_only = std::strncmp(argv[1], "--", 2) == 0;
+    std::string domain = serve_only ? "" : argv[1];
     std::string qtype_str = "A";
     uint16_t qtype_code = 1;
+    bool dual_stack = false; // --type=ADDR: A and AAAA together
 
     bool trace = false;
+    bool trace_hops = false; // --trace=hops: waterfall of every upstream hop
+    std::string trace_json_path;
     bool show_ttl_only = false;
     int bench_n = 1;
+    std::string zone_path;
+    std::string blocklist_path;
+    bool sinkhole = false;
+    std::string shm_cache_name;
+    bool shm_cache_reset = false; // drop the segment and start a fresh one
+    std::string snapshot_path;
+    CachePolicy cache_policy = CachePolicy::Lru;
+    size_t cache_mem = 0;
+    std::string record_path;
+    std::string replay_path;
+    bool replay_zero_latency = false;
+    bool use_dot = false;
+    DotOptions dot_opts;
+    ServerOptions server_opts;
+    bool serve = false;
+    bool flood_guard = false;
+    bool flood_drop = false;
+    std::vector<std::string> upstreams;
+    uint16_t upstream_port = 53;
 
-    for (int i = 2; i < argc; ++i)
+    for (int i = serve_only ? 1 : 2; i < argc; ++i)
     {
         if (std::strncmp(argv[i], "--type=", 7) == 0)
         {
             qtype_str = std::string(argv[i] + 7);
-            qtype_code = qtype_string_to_code(qtype_str);
+            dual_stack = (qtype_str == "ADDR");
+            qtype_code = dual_stack ? 1 : qtype_string_to_code(qtype_str);
             if (qtype_code == 0)
             {
                 std::cerr << "Error: Unsupported record type \"" << qtype_str << "\".\n";
@@ -66,6 +314,15 @@ int main(int argc, char *argv[])
         {
             trace = true;
         }
+        else if (std::strcmp(argv[i], "--trace=hops") == 0)
+        {
+            trace = true;
+            trace_hops = true;
+        }
+        else if (std::strncmp(argv[i], "--trace-json=", 13) == 0)
+        {
+            trace_json_path = argv[i] + 13;
+        }
         else if (std::strcmp(argv[i], "--show-ttl") == 0)
         {
             show_ttl_only = true;
@@ -74,6 +331,165 @@ int main(int argc, char *argv[])
         {
             bench_n = std::max(1, std::atoi(argv[i] + 8));
         }
+        else if (std::strncmp(argv[i], "--zone=", 7) == 0)
+        {
+            zone_path = argv[i] + 7;
+        }
+        else if (std::strncmp(argv[i], "--shm-cache=", 12) == 0)
+        {
+            shm_cache_name = argv[i] + 12;
+        }
+        else if (std::strcmp(argv[i], "--shm-cache-reset") == 0)
+        {
+            shm_cache_reset = true;
+        }
+        else if (std::strncmp(argv[i], "--cache-policy=", 15) == 0)
+        {
+            std::string policy = argv[i] + 15;
+            if (policy != "lru" && policy != "tinylfu")
+            {
+                std::cerr << "Error: Unsupported cache policy \"" << policy << "\".\n";
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            cache_policy = (policy == "tinylfu") ? CachePolicy::WTinyLfu : CachePolicy::Lru;
+        }
+        else if (std::strncmp(argv[i], "--cache-mem=", 12) == 0)
+        {
+            cache_mem = parse_byte_size(argv[i] + 12);
+            if (cache_mem == 0)
+            {
+                std::cerr << "Error: Invalid cache size \"" << (argv[i] + 12) << "\".\n";
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (std::strncmp(argv[i], "--snapshot=", 11) == 0)
+        {
+            snapshot_path = argv[i] + 11;
+        }
+        else if (std::strncmp(argv[i], "--blocklist=", 12) == 0)
+        {
+            blocklist_path = argv[i] + 12;
+        }
+        else if (std::strncmp(argv[i], "--block-mode=", 13) == 0)
+        {
+            std::string mode = argv[i] + 13;
+            if (mode != "nxdomain" && mode != "sinkhole")
+            {
+                std::cerr << "Error: Unsupported block mode \"" << mode << "\".\n";
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            sinkhole = (mode == "sinkhole");
+        }
+        else if (std::strncmp(argv[i], "--serve=", 8) == 0)
+        {
+            int port = std::atoi(argv[i] + 8);
+            if (port <= 0 || port > 65535)
+            {
+                std::cerr << "Error: Invalid port \"" << (argv[i] + 8) << "\".\n";
+                return EXIT_FAILURE;
+            }
+            server_opts.port = static_cast<uint16_t>(port);
+            serve = true;
+        }
+        else if (std::strncmp(argv[i], "--listen=", 9) == 0)
+        {
+            server_opts.listen_ip = argv[i] + 9;
+        }
+        else if (std::strncmp(argv[i], "--io=", 5) == 0)
+        {
+            std::string io = argv[i] + 5;
+            if (io == "auto")
+                server_opts.io = ServerIo::Auto;
+            else if (io == "uring")
+                server_opts.io = ServerIo::IoUring;
+            else if (io == "epoll")
+                server_opts.io = ServerIo::Epoll;
+            else
+            {
+                std::cerr << "Error: Unsupported I/O backend \"" << io << "\".\n";
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (std::strncmp(argv[i], "--record=", 9) == 0)
+        {
+            record_path = argv[i] + 9;
+        }
+        else if (std::strncmp(argv[i], "--replay=", 9) == 0)
+        {
+            replay_path = argv[i] + 9;
+        }
+        else if (std::strncmp(argv[i], "--replay-latency=", 17) == 0)
+        {
+            std::string latency = argv[i] + 17;
+            if (latency != "recorded" && latency != "zero")
+            {
+                std::cerr << "Error: Unsupported replay latency \"" << latency << "\".\n";
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            replay_zero_latency = (latency == "zero");
+        }
+        else if (std::strcmp(argv[i], "--flood-guard") == 0 || std::strncmp(argv[i], "--flood-guard=", 14) == 0)
+        {
+            std::string mode = argv[i][13] == '=' ? argv[i] + 14 : "nxdomain";
+            if (mode != "nxdomain" && mode != "drop")
+            {
+                std::cerr << "Error: Unsupported flood guard mode \"" << mode << "\".\n";
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            flood_guard = true;
+            flood_drop = (mode == "drop");
+        }
+        else if (std::strncmp(argv[i], "--upstream=", 11) == 0)
+        {
+            // IP[:PORT],...; one port for all of them
+            std::string list = argv[i] + 11;
+            size_t start = 0;
+            while (start <= list.size())
+            {
+                size_t comma = std::min(list.find(',', start), list.size());
+                std::string item = list.substr(start, comma - start);
+                size_t colon = item.rfind(':');
+                if (colon != std::string::npos && item.find(':') == colon)
+                {
+                    int port = std::atoi(item.c_str() + colon + 1);
+                    if (port <= 0 || port > 65535)
+                    {
+                        std::cerr << "Error: Invalid upstream \"" << item << "\".\n";
+                        return EXIT_FAILURE;
+                    }
+                    upstream_port = static_cast<uint16_t>(port);
+                    item.resize(colon);
+                }
+                if (!item.empty())
+                    upstreams.push_back(item);
+                start = comma + 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--dot") == 0)
+        {
+            use_dot = true;
+        }
+        else if (std::strncmp(argv[i], "--dot-port=", 11) == 0)
+        {
+            use_dot = true;
+            dot_opts.port = static_cast<uint16_t>(std::atoi(argv[i] + 11));
+        }
+        else if (std::strncmp(argv[i], "--dot-ca=", 9) == 0)
+        {
+            use_dot = true;
+            dot_opts.ca_file = argv[i] + 9;
+        }
+        else if (std::strncmp(argv[i], "--dot-name=", 11) == 0)
+        {
+            use_dot = true;
+            dot_opts.server_name = argv[i] + 11;
+        }
         else
         {
             std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
@@ -82,69 +498,296 @@ int main(int argc, char *argv[])
         }
     }
 
-    // TTL-aware LRU cache for (domain|qtype) -> answers
-    static LruTtlCache<std::string, std::vector<std::string>> dns_cache(512);
+    if (serve_only && !serve)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!record_path.empty() && !replay_path.empty())
+    {
+        std::cerr << "Error: --record and --replay are mutually exclusive.\n";
+        return EXIT_FAILURE;
+    }
+
+    // The server's resolver keeps its own in-process cache; only a snapshot
+    // can warm it
+    if (serve && !shm_cache_name.empty())
+    {
+        std::cerr << "Error: --shm-cache is not supported with --serve; use --snapshot.\n";
+        return EXIT_FAILURE;
+    }
+
+    if (!upstreams.empty())
+        set_upstream_servers(upstreams, upstream_port);
+
+    // Upstream exchanges are captured to, or served from, a capture file
+    if (!record_path.empty() && !transport_start_recording(record_path))
+        return EXIT_FAILURE;
+    if (!replay_path.empty() && !transport_start_replay(replay_path, replay_zero_latency))
+        return EXIT_FAILURE;
+
+    // Encrypted upstreams; a replay never reaches the network, so it wins
+    if (use_dot && !dot_enable(dot_opts))
+        return EXIT_FAILURE;
+
+    // TTL-aware LRU cache for (domain|qtype) -> answers, bounded by entry
+    // count or, with --cache-mem, by charged bytes
+    static DnsAnswerCache dns_cache(cache_mem ? cache_mem : 512, cache_policy,
+                                    cache_mem ? CacheLimit::Bytes : CacheLimit::Entries);
+
+    // One cache entry per family; ADDR looks up A and AAAA separately
+    const std::vector<uint16_t> families = dual_stack ? std::vector<uint16_t>{1, 28}
+                                                      : std::vector<uint16_t>{qtype_code};
+    auto type_name = [&](uint16_t qtype)
+    { return dual_stack ? std::string(qtype == 1 ? "A" : "AAAA") : qtype_str; };
+
+    // Optional host-wide cache in POSIX shared memory; replaces the in-process
+    // LRU so every resolver process (and the next run) sees the same entries
+    constexpr uint32_t SHM_CACHE_BUCKETS = 4096;
+    ShmDnsCache shm_cache;
+    if (!shm_cache_name.empty() && shm_cache_reset)
+        ShmDnsCache::unlink(shm_cache_name);
+    if (!shm_cache_name.empty() && !shm_cache.open(shm_cache_name, SHM_CACHE_BUCKETS))
+        return EXIT_FAILURE;
+
+    auto cache_get = [&](const std::string &key, std::vector<std::string> &out, uint32_t &ttl_left,
+                         bool probe)
+    {
+        return shm_cache.attached() ? shm_cache.get(key, out, ttl_left)
+                                    : dns_cache.get(key, out, ttl_left, probe);
+    };
+    auto cache_put = [&](const std::string &key, const std::vector<std::string> &val, uint32_t ttl)
+    {
+        if (shm_cache.attached())
+            shm_cache.put(key, val, ttl);
+        else
+            dns_cache.put(key, val, ttl);
+    };
+    // Per lookup, not per entry: a name reached through cached CNAMEs is one hit
+    size_t lookup_hits = 0, lookup_misses = 0;
+
+    // Warm start: the in-process cache is restored from and saved to a snapshot
+    // (the shared-memory cache already survives restarts on its own)
+    bool use_snapshot = !snapshot_path.empty() && !shm_cache.attached() && !serve;
+    if (use_snapshot)
+    {
+        size_t restored = 0;
+        load_cache_snapshot(dns_cache, snapshot_path, &restored);
+        if (trace)
+            std::cout << "[SNAP] restored " << restored << " entries from " << snapshot_path << "\n";
+        std::signal(SIGINT, on_stop);
+        std::signal(SIGTERM, on_stop);
+    }
+    auto last_snapshot = std::chrono::steady_clock::now();
+
+    // Compiled local overrides, consulted before the cache
+    LocalZone local_zone;
+    if (!zone_path.empty() && !local_zone.open(zone_path))
+        return EXIT_FAILURE;
 
-    const std::string cache_key = domain + "|" + std::to_string(qtype_code);
+    // Blocklist is checked first; SIGHUP swaps in a rebuilt image
+    BlocklistHandle blocklist;
+    if (!blocklist_path.empty())
+    {
+        if (!blocklist.reload(blocklist_path))
+            return EXIT_FAILURE;
+        std::signal(SIGHUP, on_sighup);
+    }
+
+    if (serve)
+    {
+        DnsResolverOptions resolver_opts;
+        resolver_opts.cache_entries = 512;
+        resolver_opts.cache_bytes = cache_mem;
+        resolver_opts.tinylfu = (cache_policy == CachePolicy::WTinyLfu);
+        resolver_opts.flood_guard = flood_guard;
+        int rc = run_server(server_opts, resolver_opts, blocklist, blocklist_path, sinkhole,
+                            local_zone, flood_drop, snapshot_path, trace);
+        transport_stop();
+        dot_disable();
+        return rc;
+    }
 
     try
     {
         if (show_ttl_only)
         {
-            std::vector<std::string> dummy;
-            uint32_t ttl_left = 0;
-            if (dns_cache.get(cache_key, dummy, ttl_left))
+            for (size_t f = 0; f < families.size(); ++f)
             {
-                std::cout << "Cache TTL remaining for " << domain
-                          << " (type=" << qtype_str << "): " << ttl_left << "s\n";
-            }
-            else
-            {
-                std::cout << "No unexpired cache entry for " << domain
-                          << " (type=" << qtype_str << ").\n";
+                std::vector<std::string> dummy;
+                ChainLookup look;
+                if (chain_get(domain, families[f], cache_get, dummy, look))
+                {
+                    std::cout << "Cache TTL remaining for " << domain
+                              << " (type=" << type_name(families[f]) << "): " << look.ttl << "s\n";
+                }
+                else
+                {
+                    std::cout << "No unexpired cache entry for " << domain
+                              << " (type=" << type_name(families[f]) << ").\n";
+                }
             }
             return EXIT_SUCCESS;
         }
 
+        // Spans of every miss; printed per lookup and/or written out at the end
+        ResolveTrace hop_trace;
+        if (trace_hops || !trace_json_path.empty())
+            set_resolve_trace(&hop_trace);
+
         using Clock = std::chrono::high_resolution_clock;
         auto bench_start = Clock::now();
+#ifdef DNS_ALLOC_STATS
+        size_t miss_allocs = 0, miss_count = 0;
+#endif
 
-        for (int run = 1; run <= bench_n; ++run)
+        for (int run = 1; run <= bench_n && !g_stop; ++run)
         {
             std::vector<std::string> answers;
             uint32_t ttl_left = 0;
 
-            auto start_time = Clock::now();
-            bool hit = dns_cache.get(cache_key, answers, ttl_left);
-            if (!hit)
+            if (use_snapshot &&
+                std::chrono::steady_clock::now() - last_snapshot >= std::chrono::seconds(SNAPSHOT_INTERVAL_SEC))
             {
-                // network resolve with TTL
-                DnsResult res = resolve_with_ttl(domain, qtype_code);
+                save_cache_snapshot(dns_cache, snapshot_path);
+                last_snapshot = std::chrono::steady_clock::now();
+            }
 
-                // TTL policy: min TTL across the RRset (and CNAME chain)
-                uint32_t ttl_to_cache = res.min_ttl;
-                if (res.nxdomain)
-                    ttl_to_cache = std::max<uint32_t>(ttl_to_cache, 60);
+            if (g_reload_blocklist)
+            {
+                g_reload_blocklist = 0;
+                if (blocklist.reload(blocklist_path))
+                    log_info("Reloaded blocklist " + blocklist_path);
+            }
+
+            auto start_time = Clock::now();
+            auto active_blocklist = blocklist.current();
+            bool blocked = active_blocklist && active_blocklist->blocked(domain);
 
-                answers = std::move(res.answers);
-                if (!answers.empty() || res.nxdomain)
+            // Each family is answered by the blocklist, the zone or the cache,
+            // or left for the network
+            std::vector<std::string> family_answers[2];
+            uint32_t family_ttl[2] = {0, 0};
+            ChainLookup look[2];
+            size_t missing[2];
+            size_t n_missing = 0;
+            for (size_t f = 0; f < families.size(); ++f)
+            {
+                uint16_t qtype = families[f];
+                ZoneAnswers zone_answers;
+                if (blocked)
                 {
-                    dns_cache.put(cache_key, answers, ttl_to_cache == 0 ? 60 : ttl_to_cache);
-                    ttl_left = ttl_to_cache;
+                    if (sinkhole && qtype == 1)
+                        family_answers[f].emplace_back("0.0.0.0");
+                    else if (sinkhole && qtype == 28)
+                        family_answers[f].emplace_back("::");
+                    if (trace)
+                    {
+                        std::cout << "[BLOCK] " << domain
+                                  << " type=" << type_name(qtype)
+                                  << (sinkhole ? " sinkhole" : " nxdomain") << "\n";
+                    }
+                }
+                else if (local_zone.loaded() && local_zone.lookup(domain, qtype, zone_answers))
+                {
+                    zone_answers.for_each([&](std::string_view a)
+                                          { family_answers[f].emplace_back(a); });
+                    family_ttl[f] = zone_answers.ttl();
+                    if (trace)
+                    {
+                        std::cout << "[ZONE] " << domain
+                                  << " type=" << type_name(qtype)
+                                  << " ttl=" << family_ttl[f] << "s\n";
+                    }
+                }
+                else if (chain_get(domain, qtype, cache_get, family_answers[f], look[f]))
+                {
+                    lookup_hits++;
+                    family_ttl[f] = look[f].ttl;
+                    if (trace)
+                    {
+                        std::cout << "[HIT ] " << domain
+                                  << " type=" << type_name(qtype)
+                                  << " ttl_left=" << family_ttl[f] << "s";
+                        if (look[f].links > 0)
+                            std::cout << " via " << look[f].links << " cached CNAME(s)";
+                        std::cout << "\n";
+                    }
+                }
+                else
+                {
+                    lookup_misses++;
+                    missing[n_missing++] = f;
+                }
+            }
+
+            if (n_missing > 0)
+            {
+                // network resolve with TTL, starting at the first uncached link;
+                // two missing families at the same name go out together
+                DnsResult results[2];
+                size_t first_span = hop_trace.spans().size();
+#ifdef DNS_ALLOC_STATS
+                size_t allocs_before = g_heap_allocs.load(std::memory_order_relaxed);
+#endif
+                if (n_missing == 2 && look[0].tail == look[1].tail)
+                {
+                    DualStackResult both = resolve_dual_stack_with_ttl(look[0].tail);
+                    results[0] = std::move(both.a);
+                    results[1] = std::move(both.aaaa);
+                }
+                else
+                {
+                    for (size_t m = 0; m < n_missing; ++m)
+                        results[m] = resolve_with_ttl(look[missing[m]].tail, families[missing[m]]);
+                }
+#ifdef DNS_ALLOC_STATS
+                miss_allocs += g_heap_allocs.load(std::memory_order_relaxed) - allocs_before;
+                miss_count++;
+#endif
+                if (trace_hops)
+                {
+                    std::cout << "[HOPS] " << domain << "\n";
+                    hop_trace.print_waterfall(std::cout, first_span);
                 }
 
-                if (trace)
+                for (size_t m = 0; m < n_missing; ++m)
                 {
-                    std::cout << "[MISS] " << domain
-                              << " type=" << qtype_str
-                              << " cached_ttl=" << ttl_to_cache << "s\n";
+                    size_t f = missing[m];
+                    DnsResult &res = results[m];
+
+                    // Each CNAME link and the final RRset are cached with their
+                    // own TTLs; the answer here carries the shortest of them
+                    chain_put(look[f].tail, families[f], res, cache_put);
+                    uint32_t ttl_to_cache = chain_answer_ttl(look[f], res);
+                    if (!res.answers.empty() || res.nxdomain)
+                        family_ttl[f] = ttl_to_cache;
+
+                    if (trace)
+                    {
+                        std::cout << "[MISS] " << domain
+                                  << " type=" << type_name(families[f]);
+                        if (look[f].links > 0)
+                            std::cout << " from " << look[f].tail;
+                        std::cout << " cached_ttl=" << ttl_to_cache << "s";
+                        if (!res.chain.empty())
+                            std::cout << " cname_links=" << res.chain.size();
+                        std::cout << "\n";
+                    }
+                    family_answers[f] = std::move(res.answers);
                 }
             }
-            else if (trace)
+
+            // Merged result in family order; the TTL is the shortest of the two
+            for (size_t f = 0; f < families.size(); ++f)
             {
-                std::cout << "[HIT ] " << domain
-                          << " type=" << qtype_str
-                          << " ttl_left=" << ttl_left << "s\n";
+                if (family_answers[f].empty())
+                    continue;
+                if (answers.empty() || family_ttl[f] < ttl_left)
+                    ttl_left = family_ttl[f];
+                answers.insert(answers.end(), std::make_move_iterator(family_answers[f].begin()),
+                               std::make_move_iterator(family_answers[f].end()));
             }
 
             auto end_time = Clock::now();
@@ -178,9 +821,30 @@ int main(int argc, char *argv[])
         {
             auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(bench_end - bench_start).count();
             std::cout << "Benchmark: " << bench_n << " runs in " << total_ms << " ms\n";
-            std::cout << "Cache stats: hits=" << dns_cache.hits()
-                      << " misses=" << dns_cache.misses() << "\n";
+            std::cout << "Cache stats: hits=" << lookup_hits << " misses=" << lookup_misses << "\n";
+            if (!shm_cache.attached())
+                std::cout << "Cache memory: used=" << dns_cache.bytes_used()
+                          << " peak=" << dns_cache.peak_bytes() << " bytes\n";
+#ifdef DNS_ALLOC_STATS
+            if (miss_count > 0)
+                std::cout << "Heap allocations per miss: "
+                          << (miss_allocs / miss_count) << "\n";
+#endif
+        }
+        if (trace || bench_n > 1)
+            print_dot_stats();
+        set_resolve_trace(nullptr);
+        if (!trace_json_path.empty() && hop_trace.write_chrome_json(trace_json_path) && trace)
+            std::cout << "[HOPS] " << hop_trace.spans().size() << " spans written to " << trace_json_path << "\n";
+
+        if (use_snapshot)
+        {
+            save_cache_snapshot(dns_cache, snapshot_path);
+            if (trace)
+                std::cout << "[SNAP] saved " << dns_cache.size() << " entries to " << snapshot_path << "\n";
         }
+        transport_stop();
+        dot_disable();
     }
     catch (const std::exception &ex)
     {
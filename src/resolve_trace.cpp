@@ -0,0 +1,198 @@
+#include "resolve_trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+static thread_local ResolveTrace *g_trace = nullptr;
+
+void set_resolve_trace(ResolveTrace *trace)
+{
+    g_trace = trace;
+}
+
+ResolveTrace *current_resolve_trace()
+{
+    return g_trace;
+}
+
+static const char *kind_name(SpanKind kind)
+{
+    switch (kind)
+    {
+    case SpanKind::Resolve:
+        return "resolve";
+    case SpanKind::Query:
+        return "query";
+    case SpanKind::Cname:
+        return "cname";
+    case SpanKind::NsLookup:
+        return "ns";
+    }
+    return "?";
+}
+
+static std::string qtype_name(uint16_t qtype)
+{
+    switch (qtype)
+    {
+    case 0:
+        return "A+AAAA";
+    case 1:
+        return "A";
+    case 2:
+        return "NS";
+    case 5:
+        return "CNAME";
+    case 15:
+        return "MX";
+    case 28:
+        return "AAAA";
+    }
+    return "TYPE" + std::to_string(qtype);
+}
+
+static std::string rcode_name(int rcode)
+{
+    static const char *NAMES[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED"};
+    if (rcode < 0)
+        return "no reply";
+    if (rcode < 6)
+        return NAMES[rcode];
+    return "RCODE" + std::to_string(rcode);
+}
+
+// "query www.example.com A @1.1.1.1:53 NOERROR 120B", without the detail
+static std::string label(const TraceSpan &s)
+{
+    std::string out = std::string(kind_name(s.kind)) + " " + s.name + " " + qtype_name(s.qtype);
+    if (s.kind == SpanKind::Query)
+    {
+        out += " @" + s.server + " " + rcode_name(s.rcode);
+        if (s.rcode >= 0)
+            out += " " + std::to_string(s.bytes) + "B";
+    }
+    return out;
+}
+
+ResolveTrace::ResolveTrace() : start_(std::chrono::steady_clock::now()) {}
+
+int64_t ResolveTrace::now_us() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+}
+
+size_t ResolveTrace::begin(SpanKind kind, const std::string &name, uint16_t qtype, const std::string &server)
+{
+    TraceSpan s;
+    s.kind = kind;
+    s.depth = static_cast<int>(open_.size());
+    s.name = name;
+    s.qtype = qtype;
+    s.server = server;
+    s.start_us = now_us();
+    if (kind == SpanKind::Query)
+        s.lane = queries_in_flight_++;
+    else
+        open_.push_back(spans_.size());
+    spans_.push_back(std::move(s));
+    return spans_.size() - 1;
+}
+
+void ResolveTrace::end(size_t span)
+{
+    TraceSpan &s = spans_[span];
+    if (s.end_us >= 0)
+        return;
+    s.end_us = now_us();
+    if (s.kind == SpanKind::Query)
+        queries_in_flight_--;
+    else
+        open_.erase(std::find(open_.begin(), open_.end(), span));
+}
+
+void ResolveTrace::print_waterfall(std::ostream &os, size_t first) const
+{
+    constexpr int BAR_WIDTH = 24;
+    if (first >= spans_.size())
+        return;
+
+    int64_t origin = spans_[first].start_us;
+    int64_t total = 1;
+    for (size_t i = first; i < spans_.size(); ++i)
+        total = std::max(total, std::max(spans_[i].end_us, spans_[i].start_us) - origin);
+
+    char cols[64];
+    std::snprintf(cols, sizeof(cols), "%10s %10s", "start_us", "dur_us");
+    os << cols << "\n";
+    for (size_t i = first; i < spans_.size(); ++i)
+    {
+        const TraceSpan &s = spans_[i];
+        int64_t start = s.start_us - origin;
+        int64_t dur = std::max<int64_t>(0, (s.end_us < 0 ? s.start_us : s.end_us) - s.start_us);
+
+        std::string bar(BAR_WIDTH, ' ');
+        int from = static_cast<int>(start * BAR_WIDTH / total);
+        int to = static_cast<int>((start + dur) * BAR_WIDTH / total);
+        for (int c = std::min(from, BAR_WIDTH - 1); c <= std::min(std::max(to - 1, from), BAR_WIDTH - 1); ++c)
+            bar[c] = '#';
+
+        std::snprintf(cols, sizeof(cols), "%10lld %10lld  |", static_cast<long long>(start),
+                      static_cast<long long>(dur));
+        os << cols << bar << "|  " << std::string(2 * s.depth, ' ') << label(s);
+        if (!s.detail.empty())
+            os << ": " << s.detail;
+        os << "\n";
+    }
+}
+
+static std::string json_escape(const std::string &in)
+{
+    std::string out;
+    for (char c : in)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", static_cast<unsigned>(c));
+            out += esc;
+        }
+        else
+            out += c;
+    }
+    return out;
+}
+
+bool ResolveTrace::write_chrome_json(const std::string &path) const
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Cannot write trace " << path << "\n";
+        return false;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (size_t i = 0; i < spans_.size(); ++i)
+    {
+        const TraceSpan &s = spans_[i];
+        int64_t dur = std::max<int64_t>(0, (s.end_us < 0 ? s.start_us : s.end_us) - s.start_us);
+        out << "{\"name\":\"" << json_escape(label(s)) << "\",\"cat\":\"" << kind_name(s.kind)
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (1 + s.lane) << ",\"ts\":" << s.start_us
+            << ",\"dur\":" << dur << ",\"args\":{\"qname\":\"" << json_escape(s.name)
+            << "\",\"qtype\":\"" << qtype_name(s.qtype) << "\"";
+        if (s.kind == SpanKind::Query)
+            out << ",\"server\":\"" << json_escape(s.server) << "\",\"rcode\":\"" << rcode_name(s.rcode)
+                << "\",\"bytes\":" << s.bytes;
+        if (!s.detail.empty())
+            out << ",\"detail\":\"" << json_escape(s.detail) << "\"";
+        out << "}}" << (i + 1 < spans_.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    return static_cast<bool>(out);
+}
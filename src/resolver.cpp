@@ -2,30 +2,47 @@
 #include "dns_utils.h"
 #include "dns_client.h"
 #include "resolver.h"
+#include "resolve_trace.h"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unordered_set>
 #include <unordered_map>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <cstddef>
 #include <unistd.h>
 
 static const std::vector<std::string> ROOT_SERVERS = {
     "1.1.1.1", "8.8.8.8", "9.9.9.9"};
 
+// First-hop servers; referrals always go to port 53
+static std::vector<std::string> g_upstreams = ROOT_SERVERS;
+static uint16_t g_upstream_port = 53;
+
+void set_upstream_servers(const std::vector<std::string> &ips, uint16_t port)
+{
+    g_upstreams = ips.empty() ? ROOT_SERVERS : ips;
+    g_upstream_port = port;
+}
+
 // Legacy recursive resolver (no TTL), retained for completeness.
 std::vector<std::string> resolve(const std::string &domain, uint16_t qtype)
 {
     std::unordered_set<std::string> visited_cnames;
-    std::vector<std::string> nameservers = ROOT_SERVERS;
+    std::vector<std::string> nameservers = g_upstreams;
+    uint16_t port = g_upstream_port;
 
     while (!nameservers.empty())
     {
         for (const std::string &ns_ip : nameservers)
         {
             std::vector<uint8_t> query = build_query_packet(domain, qtype);
-            int sockfd = send_query(query, ns_ip, 53);
+            int sockfd = send_query(query, ns_ip, port);
             if (sockfd < 0)
                 continue;
 
@@ -124,6 +141,7 @@ std::vector<std::string> resolve(const std::string &domain, uint16_t qtype)
             if (!next_hop.empty())
             {
                 nameservers.swap(next_hop);
+                port = 53;
                 break;
             }
         }
@@ -132,11 +150,93 @@ std::vector<std::string> resolve(const std::string &domain, uint16_t qtype)
 }
 
 // TTL-aware recursive resolver used by cached CLI
-static DnsResult parse_answers_and_ttl(const std::vector<uint8_t> &raw,
-                                       uint16_t qtype,
-                                       std::vector<std::string> &out_addrs,
-                                       std::string &out_cname,
-                                       uint32_t &out_min_ttl)
+//
+// Everything a miss allocates (query/receive buffers, decoded names, the glue
+// table, NS lists, the visited-CNAME set) comes from one per-resolution arena.
+// The arena is seeded with an inline buffer, so a typical miss performs no heap
+// allocation of its own; deep referral chains spill into upstream blocks that
+// are all released together when the context goes away.
+struct ResolveContext
+{
+    static constexpr size_t INLINE_ARENA_BYTES = 8192;
+
+    alignas(std::max_align_t) std::byte inline_buf[INLINE_ARENA_BYTES];
+    std::pmr::monotonic_buffer_resource arena{inline_buf, sizeof(inline_buf)};
+};
+
+using NameSet = std::pmr::unordered_set<std::pmr::string>;
+
+// Span in the thread's ResolveTrace, or nothing when no trace is installed;
+// ends when it goes out of scope at the latest
+class TraceScope
+{
+public:
+    TraceScope(SpanKind kind, std::string_view name, uint16_t qtype,
+               std::string_view server = {}, uint16_t port = 0)
+        : trace_(current_resolve_trace())
+    {
+        if (trace_)
+            span_ = trace_->begin(kind, std::string(name), qtype,
+                                  server.empty() ? std::string() : std::string(server) + ":" + std::to_string(port));
+    }
+    ~TraceScope() { end(); }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    explicit operator bool() const { return trace_ != nullptr; }
+    void end()
+    {
+        if (trace_)
+            trace_->end(span_);
+    }
+    void detail(std::string text)
+    {
+        if (trace_)
+            trace_->span(span_).detail = std::move(text);
+    }
+    void detail(const char *text) // no string built when not tracing
+    {
+        if (trace_)
+            trace_->span(span_).detail = text;
+    }
+    void reply(const std::pmr::vector<uint8_t> &raw)
+    {
+        if (!trace_)
+            return;
+        TraceSpan &s = trace_->span(span_);
+        s.rcode = raw.size() >= sizeof(DNSHeader) ? (raw[3] & 0x0F) : -1;
+        s.bytes = raw.size();
+    }
+
+private:
+    ResolveTrace *trace_;
+    size_t span_ = 0;
+};
+
+static std::string describe(const DnsResult &res)
+{
+    if (res.nxdomain)
+        return "NXDOMAIN";
+    if (res.answers.empty())
+        return res.nodata ? "NODATA" : "no answer";
+    return std::to_string(res.answers.size()) + (res.answers.size() == 1 ? " answer" : " answers") +
+           ", ttl " + std::to_string(res.min_ttl) + "s";
+}
+
+static std::string lowercase_name(std::string_view name)
+{
+    std::string out(name);
+    for (char &c : out)
+    {
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+    }
+    return out;
+}
+
+// Addresses, the CNAME chain starting at the question name, and their TTLs.
+// CNAME records that are not on that chain are ignored.
+static DnsResult parse_answers_and_ttl(const std::pmr::vector<uint8_t> &raw, uint16_t qtype)
 {
     DnsResult res;
     if (raw.size() < sizeof(DNSHeader))
@@ -158,18 +258,22 @@ static DnsResult parse_answers_and_ttl(const std::vector<uint8_t> &raw,
 
     size_t off = sizeof(DNSHeader);
 
-    // skip questions
+    // skip questions, keeping the first name
+    std::pmr::string qname(raw.get_allocator().resource());
     for (int i = 0; i < qd; ++i)
     {
-        decode_domain(raw, off);
+        std::pmr::string name = decode_domain(raw, off);
+        if (i == 0)
+            qname = std::move(name);
         off += 4;
     }
 
     uint32_t min_ttl = UINT32_MAX;
-    std::string cname;
+    uint32_t answer_ttl = UINT32_MAX;
+    std::vector<CnameLink> cnames;
     for (int i = 0; i < an; ++i)
     {
-        decode_domain(raw, off); // owner
+        std::pmr::string owner = decode_domain(raw, off);
         uint16_t type = read_u16(raw, off);
         off += 2;
         (void)read_u16(raw, off);
@@ -183,86 +287,137 @@ static DnsResult parse_answers_and_ttl(const std::vector<uint8_t> &raw,
         {
             char ip[INET_ADDRSTRLEN];
             inet_ntop(AF_INET, raw.data() + off, ip, sizeof(ip));
-            out_addrs.emplace_back(ip);
-            if (ttl < min_ttl)
-                min_ttl = ttl;
+            res.answers.emplace_back(ip);
+            answer_ttl = std::min(answer_ttl, ttl);
         }
         else if (type == 28 && rdlen == 16)
         {
             char ip6[INET6_ADDRSTRLEN];
             inet_ntop(AF_INET6, raw.data() + off, ip6, sizeof(ip6));
-            out_addrs.emplace_back(ip6);
-            if (ttl < min_ttl)
-                min_ttl = ttl;
+            res.answers.emplace_back(ip6);
+            answer_ttl = std::min(answer_ttl, ttl);
         }
         else if (type == 5)
         { // CNAME
             size_t rdoff = off;
-            cname = decode_domain(raw, rdoff);
-            if (ttl < min_ttl)
-                min_ttl = ttl;
+            cnames.push_back(CnameLink{lowercase_name(owner), lowercase_name(decode_domain(raw, rdoff)), ttl});
         }
         off += rdlen;
     }
 
-    out_cname = std::move(cname);
-    if (min_ttl != UINT32_MAX)
-        out_min_ttl = min_ttl;
+    // Link the CNAMEs up in order, starting from the question name
+    std::string next = lowercase_name(qname);
+    while (res.chain.size() < cnames.size())
+    {
+        auto it = std::find_if(cnames.begin(), cnames.end(), [&](const CnameLink &l)
+                               { return l.owner == next; });
+        if (it == cnames.end())
+            break;
+        next = it->target;
+        min_ttl = std::min(min_ttl, it->ttl);
+        res.chain.push_back(std::move(*it));
+        it->owner.clear(); // taken
+    }
+
+    min_ttl = std::min(min_ttl, answer_ttl);
     res.min_ttl = (min_ttl == UINT32_MAX) ? 0 : min_ttl;
+    res.answer_ttl = (answer_ttl == UINT32_MAX) ? 0 : answer_ttl;
     return res;
 }
 
-DnsResult resolve_with_ttl(const std::string &domain, uint16_t qtype)
+static DnsResult resolve_in(ResolveContext &ctx, std::string_view domain, uint16_t qtype,
+                            NameSet &visited_cnames, SpanKind why = SpanKind::Resolve)
 {
-    std::unordered_set<std::string> visited_cnames;
-    std::vector<std::string> nameservers = ROOT_SERVERS;
+    std::pmr::memory_resource *mr = &ctx.arena;
+    TraceScope step(why, domain, qtype);
+
+    std::pmr::vector<std::pmr::string> nameservers(mr);
+    for (const std::string &ip : g_upstreams)
+        nameservers.emplace_back(ip.data(), ip.size());
+    uint16_t port = g_upstream_port;
+
+    // Reused for every hop; capacity is kept across iterations.
+    std::pmr::vector<uint8_t> query(mr);
+    std::pmr::vector<uint8_t> raw(mr);
+    bool saw_nodata = false; // a NOERROR reply with nothing to follow, unlike a timeout
 
     while (!nameservers.empty())
     {
-        for (const std::string &ns_ip : nameservers)
+        bool referred = false;
+        for (const std::pmr::string &ns_ip : nameservers)
         {
             // 1) send query
-            std::vector<uint8_t> query = build_query_packet(domain, qtype);
-            int sockfd = send_query(query, ns_ip, 53);
+            TraceScope hop(SpanKind::Query, domain, qtype, ns_ip, port);
+            build_query_packet(domain, qtype, query);
+            int sockfd = send_query(query, ns_ip, port);
             if (sockfd < 0)
+            {
+                hop.detail("send failed");
                 continue;
+            }
 
-            std::vector<uint8_t> raw = recv_response(sockfd, 3);
-            if (raw.empty())
+            if (!recv_response(sockfd, 3, raw))
+            {
+                hop.detail("timeout");
                 continue;
+            }
+            hop.reply(raw);
+            hop.end();
 
             // 2) parse answers with TTL
-            std::vector<std::string> addrs;
-            std::string cname;
-            uint32_t min_ttl = 0;
-            DnsResult header_res = parse_answers_and_ttl(raw, qtype, addrs, cname, min_ttl);
+            DnsResult res = parse_answers_and_ttl(raw, qtype);
 
-            if (header_res.nxdomain)
+            if (res.nxdomain)
             {
                 // Optionally parse SOA MINIMUM for negative caching; here we return NXDOMAIN with ttl=60
+                step.detail("NXDOMAIN");
                 return DnsResult{{}, 60, true};
             }
 
-            if (!addrs.empty())
+            if (!res.answers.empty())
+            {
+                if (step)
+                {
+                    hop.detail(describe(res));
+                    step.detail(describe(res));
+                }
+                return res;
+            }
+
+            // A CNAME query is answered by the name's own link
+            if (qtype == 5 && !res.chain.empty())
             {
-                return DnsResult{std::move(addrs), min_ttl, false};
+                const CnameLink &link = res.chain.front();
+                if (step)
+                    step.detail("CNAME " + link.target);
+                return DnsResult{{link.target}, link.ttl, false, {}, link.ttl};
             }
 
             // CNAME chase for A/AAAA queries
-            if ((qtype == 1 || qtype == 28) && !cname.empty())
+            if ((qtype == 1 || qtype == 28) && !res.chain.empty())
             {
-                if (!visited_cnames.insert(cname).second)
+                const std::string &target = res.chain.back().target;
+                if (hop)
+                    hop.detail("CNAME to " + target);
+                if (!visited_cnames.emplace(std::string_view(target)).second)
                 {
+                    if (step)
+                        step.detail("CNAME loop at " + target);
                     return DnsResult{{}, 0, false}; // loop
                 }
-                DnsResult next = resolve_with_ttl(cname, qtype);
-                if (!next.answers.empty())
+                DnsResult next = resolve_in(ctx, target, qtype, visited_cnames, SpanKind::Cname);
+                if (!next.answers.empty() || next.nxdomain || next.nodata)
                 {
                     // TTL for the chain = min(CNAME ttl, target ttl)
+                    uint32_t min_ttl = res.min_ttl;
                     uint32_t chain_ttl = (min_ttl == 0) ? next.min_ttl
                                                         : (next.min_ttl == 0 ? min_ttl
                                                                              : std::min(min_ttl, next.min_ttl));
                     next.min_ttl = chain_ttl;
+                    next.chain.insert(next.chain.begin(), std::make_move_iterator(res.chain.begin()),
+                                      std::make_move_iterator(res.chain.end()));
+                    if (step)
+                        step.detail(describe(next) + " via " + std::to_string(next.chain.size()) + " CNAME(s)");
                     return next;
                 }
             }
@@ -285,39 +440,36 @@ DnsResult resolve_with_ttl(const std::string &domain, uint16_t qtype)
                 skip_rr(raw, off);
             }
 
-            // collect NS from authority
-            struct NSInfo
-            {
-                std::string nsdname;
-            };
-            std::vector<NSInfo> authority;
+            // collect NS names from authority
+            std::pmr::vector<std::pmr::string> authority(mr);
+            std::pmr::string zone(mr); // owner of the NS set, for the trace
             for (int i = 0; i < ntohs(hdr.NSCOUNT); ++i)
             {
-                decode_domain(raw, off); // owner
-                uint16_t type = read16(raw, off);
+                std::pmr::string owner = decode_domain(raw, off);
+                uint16_t type = read_u16(raw, off);
                 off += 2;
                 off += 2 + 4;
-                uint16_t rdlen = read16(raw, off);
+                uint16_t rdlen = read_u16(raw, off);
                 off += 2;
                 size_t rdata_off = off;
                 if (type == 2)
                 { // NS
-                    NSInfo info;
-                    info.nsdname = decode_domain(raw, rdata_off);
-                    authority.push_back(std::move(info));
+                    authority.push_back(decode_domain(raw, rdata_off));
+                    if (zone.empty())
+                        zone = std::move(owner);
                 }
                 off += rdlen;
             }
 
             // build glue from additional
-            std::unordered_map<std::string, std::string> glue;
+            std::pmr::unordered_map<std::pmr::string, std::pmr::string> glue(mr);
             for (int i = 0; i < ntohs(hdr.ARCOUNT); ++i)
             {
-                std::string rrname = decode_domain(raw, off);
-                uint16_t type = read16(raw, off);
+                std::pmr::string rrname = decode_domain(raw, off);
+                uint16_t type = read_u16(raw, off);
                 off += 2;
                 off += 2 + 4;
-                uint16_t rdlen = read16(raw, off);
+                uint16_t rdlen = read_u16(raw, off);
                 off += 2;
 
                 if ((type == 1 || type == 28) && rdlen == (type == 1 ? 4 : 16))
@@ -325,22 +477,36 @@ DnsResult resolve_with_ttl(const std::string &domain, uint16_t qtype)
                     char ipbuf[INET6_ADDRSTRLEN];
                     inet_ntop(type == 1 ? AF_INET : AF_INET6,
                               raw.data() + off, ipbuf, sizeof(ipbuf));
-                    glue[rrname] = ipbuf;
+                    glue[std::move(rrname)] = ipbuf;
                 }
                 off += rdlen;
             }
 
-            std::vector<std::string> next_hop;
+            if (authority.empty() && (ntohs(hdr.flags) & 0x000F) == 0)
+                saw_nodata = true;
+
+            if (step)
+            {
+                size_t with_glue = std::count_if(authority.begin(), authority.end(), [&](const std::pmr::string &ns)
+                                                 { return glue.count(ns) > 0; });
+                hop.detail(authority.empty() ? (res.chain.empty() ? "no answer" : "CNAME, target unresolved")
+                                             : "referral to " + std::string(zone.empty() ? "." : zone) + " (" +
+                                                   std::to_string(authority.size()) + " NS, " +
+                                                   std::to_string(with_glue) + " with glue)");
+            }
+
+            std::pmr::vector<std::pmr::string> next_hop(mr);
             for (const auto &ns : authority)
             {
-                std::string ip;
-                auto it = glue.find(ns.nsdname);
+                std::pmr::string ip(mr);
+                auto it = glue.find(ns);
                 if (it != glue.end())
                     ip = it->second;
                 else
                 {
-                    // resolve nameserver name (A)
-                    DnsResult ns_res = resolve_with_ttl(ns.nsdname, 1);
+                    // resolve nameserver name (A); own CNAME history, same arena
+                    NameSet ns_visited(mr);
+                    DnsResult ns_res = resolve_in(ctx, ns, 1, ns_visited, SpanKind::NsLookup);
                     if (!ns_res.answers.empty())
                         ip = ns_res.answers.front();
                 }
@@ -351,10 +517,105 @@ DnsResult resolve_with_ttl(const std::string &domain, uint16_t qtype)
             if (!next_hop.empty())
             {
                 nameservers.swap(next_hop);
+                port = 53;
+                referred = true;
                 break; // follow referral
             }
         }
+        if (!referred)
+            break; // every server failed or was a dead end; don't spin on them
+    }
+
+    step.detail(saw_nodata ? "NODATA" : "no answer");
+    DnsResult none;
+    none.nodata = saw_nodata;
+    return none;
+}
+
+DnsResult resolve_with_ttl(const std::string &domain, uint16_t qtype)
+{
+    ResolveContext ctx;
+    NameSet visited_cnames(&ctx.arena);
+    return resolve_in(ctx, domain, qtype, visited_cnames);
+}
+
+DualStackResult resolve_dual_stack_with_ttl(const std::string &domain)
+{
+    ResolveContext ctx;
+    std::pmr::memory_resource *mr = &ctx.arena;
+    TraceScope step(SpanKind::Resolve, domain, 0); // qtype 0: A and AAAA
+
+    constexpr uint16_t QTYPES[2] = {1, 28};
+    DnsResult results[2];
+    bool settled[2] = {false, false};
+    bool replied[2] = {false, false}; // got an answer we can't use directly
+    std::pmr::vector<uint8_t> query[2] = {std::pmr::vector<uint8_t>(mr), std::pmr::vector<uint8_t>(mr)};
+    std::pmr::vector<uint8_t> raw[2] = {std::pmr::vector<uint8_t>(mr), std::pmr::vector<uint8_t>(mr)};
+
+    // Both questions go out back to back and both answers are waited for
+    // together, so a silent upstream costs one timeout, not one per family.
+    for (const std::string &ip : g_upstreams)
+    {
+        std::pmr::string ns_ip(ip.data(), ip.size(), mr);
+        int sockfd[2] = {-1, -1};
+        std::optional<TraceScope> hop[2]; // both in flight at once
+        for (int f = 0; f < 2; ++f)
+        {
+            if (settled[f] || replied[f])
+                continue;
+            hop[f].emplace(SpanKind::Query, domain, QTYPES[f], ns_ip, g_upstream_port);
+            build_query_packet(domain, QTYPES[f], query[f]);
+            sockfd[f] = send_query(query[f], ns_ip, g_upstream_port);
+            if (sockfd[f] < 0)
+                hop[f]->detail("send failed");
+        }
+
+        bool got[2] = {false, false};
+        recv_responses(sockfd, 2, 3, raw, got);
+        for (int f = 0; f < 2; ++f)
+        {
+            if (sockfd[f] < 0)
+                continue;
+            if (!got[f])
+            {
+                hop[f]->detail("timeout");
+                hop[f]->end();
+                continue;
+            }
+            hop[f]->reply(raw[f]);
+            hop[f]->end();
+
+            DnsResult res = parse_answers_and_ttl(raw[f], QTYPES[f]);
+            if (res.nxdomain)
+                results[f] = DnsResult{{}, 60, true};
+            else if (!res.answers.empty())
+                results[f] = std::move(res);
+            else
+            {
+                replied[f] = true; // bare CNAME or referral: left for the full walk below
+                hop[f]->detail(res.chain.empty() ? "referral or no answer, walked below" : "CNAME, walked below");
+                continue;
+            }
+            if (step)
+                hop[f]->detail(describe(results[f]));
+            settled[f] = true;
+        }
+
+        if ((settled[0] || replied[0]) && (settled[1] || replied[1]))
+            break;
+    }
+
+    // A referral or bare CNAME takes the regular iterative path; a family no
+    // upstream answered has failed, walking it would only time out again
+    for (int f = 0; f < 2; ++f)
+    {
+        if (!replied[f])
+            continue;
+        NameSet visited_cnames(mr);
+        results[f] = resolve_in(ctx, domain, QTYPES[f], visited_cnames);
     }
 
-    return DnsResult{};
+    if (step)
+        step.detail("A: " + describe(results[0]) + "; AAAA: " + describe(results[1]));
+    return DualStackResult{std::move(results[0]), std::move(results[1])};
 }
@@ -0,0 +1,288 @@
+#include "shm_cache.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Readers give up (and report a miss) rather than wait on a busy bucket;
+// writers give up rather than wait long on one, and check whether its owner
+// died.
+constexpr int READ_RETRIES = 64;
+constexpr int WRITE_RETRIES = 1 << 16;
+
+static uint64_t key_hash(const std::string &key)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key)
+    {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h | 1; // 0 marks an empty slot
+}
+
+static int64_t wall_now()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+ShmDnsCache::~ShmDnsCache()
+{
+    if (hdr_)
+        munmap(hdr_, len_);
+}
+
+bool ShmDnsCache::unlink(const std::string &name)
+{
+    return shm_unlink(name.c_str()) == 0;
+}
+
+bool ShmDnsCache::open(const std::string &name, uint32_t bucket_count)
+{
+    if (bucket_count == 0)
+        bucket_count = 1;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+    {
+        std::cerr << "shm_open " << name << " failed: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    // Openers take turns; whoever finds the segment unpublished builds it.
+    // That is the first opener, or the next one after a creator that died
+    // before publishing (the lock goes with it).
+    if (flock(fd, LOCK_EX) < 0)
+    {
+        std::cerr << "Cannot lock shared cache " << name << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return false;
+    }
+    struct stat st{};
+    uint64_t magic = 0;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(ShmCacheHeader))
+        pread(fd, &magic, sizeof(magic), 0);
+    bool build = magic != SHM_CACHE_MAGIC;
+
+    size_t len = static_cast<size_t>(st.st_size);
+    if (build)
+    {
+        if (st.st_size > 0)
+            std::cerr << "Shared cache " << name << " was left half-built; re-initialising it.\n";
+        // Truncating to 0 first zero-fills all of it: all slots empty, all
+        // seqlocks even
+        len = sizeof(ShmCacheHeader) + size_t(bucket_count) * sizeof(ShmCacheBucket);
+        if (ftruncate(fd, 0) < 0 || ftruncate(fd, static_cast<off_t>(len)) < 0)
+        {
+            std::cerr << "Cannot size shared cache " << name << ": " << std::strerror(errno) << "\n";
+            ::close(fd);
+            return false;
+        }
+    }
+
+    void *map = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "Cannot mmap shared cache " << name << ": " << std::strerror(errno) << "\n";
+        ::close(fd);
+        return false;
+    }
+
+    auto *hdr = static_cast<ShmCacheHeader *>(map);
+    if (build)
+    {
+        hdr->version = SHM_CACHE_VERSION;
+        hdr->bucket_count = bucket_count;
+        hdr->ways = SHM_CACHE_WAYS;
+        hdr->slot_bytes = SHM_CACHE_SLOT_BYTES;
+        hdr->magic.store(SHM_CACHE_MAGIC, std::memory_order_release);
+    }
+    flock(fd, LOCK_UN); // the mapping keeps the file open, so close() alone would not
+    ::close(fd);
+
+    bool ok = hdr->version == SHM_CACHE_VERSION &&
+              hdr->ways == SHM_CACHE_WAYS &&
+              hdr->slot_bytes == SHM_CACHE_SLOT_BYTES &&
+              sizeof(ShmCacheHeader) + size_t(hdr->bucket_count) * sizeof(ShmCacheBucket) == len;
+    if (!ok)
+    {
+        std::cerr << "Shared cache " << name << " has an incompatible layout; remove it with --shm-cache-reset.\n";
+        munmap(map, len);
+        return false;
+    }
+
+    hdr_ = hdr;
+    buckets_ = reinterpret_cast<ShmCacheBucket *>(static_cast<uint8_t *>(map) + sizeof(ShmCacheHeader));
+    len_ = len;
+    return true;
+}
+
+// Takes bucket `b` for writing; `seq` receives the odd sequence it now has.
+// A bucket still odd after WRITE_RETRIES spins whose owner no longer exists
+// is taken over, and its slots cleared since the dead writer may have torn
+// one. A live owner is left alone.
+bool ShmDnsCache::lock_bucket(ShmCacheBucket &b, uint32_t &seq)
+{
+    const uint64_t me = uint64_t(static_cast<uint32_t>(getpid())) << 32;
+    uint64_t w = b.lock.load(std::memory_order_relaxed);
+    for (int tries = 0; (w & 1) == 0 || tries < WRITE_RETRIES; ++tries)
+    {
+        if ((w & 1) == 0)
+        {
+            if (b.lock.compare_exchange_weak(w, me | uint32_t(w + 1), std::memory_order_acquire,
+                                             std::memory_order_relaxed))
+            {
+                seq = uint32_t(w + 1);
+                return true;
+            }
+            continue;
+        }
+        cpu_relax();
+        w = b.lock.load(std::memory_order_relaxed);
+    }
+
+    pid_t owner = static_cast<pid_t>(w >> 32);
+    if (owner <= 0 || kill(owner, 0) == 0 || errno != ESRCH)
+        return false;
+    if (!b.lock.compare_exchange_strong(w, me | uint32_t(w + 2), std::memory_order_acquire,
+                                        std::memory_order_relaxed))
+        return false; // someone else got there first
+    std::memset(static_cast<void *>(b.slots), 0, sizeof(b.slots));
+    std::cerr << "Shared cache: cleared a bucket left locked by process " << owner << ", which is gone.\n";
+    seq = uint32_t(w + 2);
+    return true;
+}
+
+bool ShmDnsCache::get(const std::string &key, std::vector<std::string> &out, uint32_t &ttl_left_sec)
+{
+    if (!hdr_ || key.size() > SHM_CACHE_KEY_MAX)
+    {
+        misses_++;
+        return false;
+    }
+
+    const uint64_t h = key_hash(key);
+    ShmCacheBucket &b = buckets_[h % hdr_->bucket_count];
+
+    ShmCacheSlot copy;
+    for (int attempt = 0; attempt < READ_RETRIES; ++attempt)
+    {
+        uint32_t s1 = static_cast<uint32_t>(b.lock.load(std::memory_order_acquire));
+        if (s1 & 1)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        bool found = false;
+        for (size_t w = 0; w < SHM_CACHE_WAYS; ++w)
+        {
+            if (b.slots[w].key_hash == h)
+            {
+                std::memcpy(&copy, &b.slots[w], sizeof(copy));
+                found = true;
+                break;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (static_cast<uint32_t>(b.lock.load(std::memory_order_relaxed)) != s1)
+            continue; // torn read, try again
+
+        int64_t now = wall_now();
+        if (!found || copy.key_len != key.size() ||
+            std::memcmp(copy.key, key.data(), key.size()) != 0 ||
+            copy.value_len > SHM_CACHE_VALUE_MAX || now >= copy.expires_at)
+            break;
+
+        out.clear();
+        const uint8_t *p = copy.value;
+        const uint8_t *end = copy.value + copy.value_len;
+        for (uint16_t i = 0; i < copy.answer_count && p < end; ++i)
+        {
+            uint8_t len = *p++;
+            out.emplace_back(reinterpret_cast<const char *>(p), len);
+            p += len;
+        }
+        ttl_left_sec = static_cast<uint32_t>(copy.expires_at - now);
+        hits_++;
+        return true;
+    }
+
+    misses_++;
+    return false;
+}
+
+void ShmDnsCache::put(const std::string &key, const std::vector<std::string> &val, uint32_t ttl_sec)
+{
+    if (!hdr_ || key.size() > SHM_CACHE_KEY_MAX)
+        return;
+
+    // Pack outside the lock; entries that don't fit a slot stay process-local.
+    uint8_t value[SHM_CACHE_VALUE_MAX];
+    size_t value_len = 0;
+    for (const auto &a : val)
+    {
+        if (a.size() > 255 || value_len + 1 + a.size() > sizeof(value))
+            return;
+        value[value_len++] = static_cast<uint8_t>(a.size());
+        std::memcpy(value + value_len, a.data(), a.size());
+        value_len += a.size();
+    }
+
+    const uint64_t h = key_hash(key);
+    ShmCacheBucket &b = buckets_[h % hdr_->bucket_count];
+
+    uint32_t s = 0;
+    if (!lock_bucket(b, s))
+        return;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Same key, else an empty/expired way, else the one expiring soonest.
+    int64_t now = wall_now();
+    ShmCacheSlot *victim = nullptr;
+    ShmCacheSlot *soonest = &b.slots[0];
+    for (auto &slot : b.slots)
+    {
+        if (slot.key_hash == h && slot.key_len == key.size() &&
+            std::memcmp(slot.key, key.data(), key.size()) == 0)
+        {
+            victim = &slot;
+            break;
+        }
+        if (!victim && (slot.key_hash == 0 || now >= slot.expires_at))
+            victim = &slot;
+        if (slot.expires_at < soonest->expires_at)
+            soonest = &slot;
+    }
+    if (!victim)
+        victim = soonest;
+
+    victim->key_hash = h;
+    victim->expires_at = now + ttl_sec;
+    victim->key_len = static_cast<uint16_t>(key.size());
+    victim->value_len = static_cast<uint16_t>(value_len);
+    victim->answer_count = static_cast<uint16_t>(val.size());
+    std::memcpy(victim->key, key.data(), key.size());
+    std::memcpy(victim->value, value, value_len);
+
+    b.lock.store(uint32_t(s + 1), std::memory_order_release); // even, no owner
+}
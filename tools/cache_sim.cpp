@@ -0,0 +1,470 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include "lru_ttl_cache.h"
+#include "cname_cache.h"
+
+// Trace-driven cache simulator. Replays a query trace (a recorded one, or a
+// synthetic Zipfian one) through LruTtlCache at several sizes and policies in
+// virtual time, and reports hit ratio, upstream queries saved and memory.
+//
+// Recorded traces are text, one query per line:
+//   <seconds since start> <name> [qtype] [ttl]
+// qtype defaults to 1 and ttl to --ttl. Lines starting with '#' are skipped.
+//
+// Synthetic names can be CNAMEs for a few shared targets (--cname), as with
+// many customer names pointing at one CDN host. The cache then either keeps
+// each link and the target's answers separately (as the resolver does) or,
+// with --cname-cache=flat, one flattened entry per name at the chain's
+// shortest TTL.
+
+using SimCache = LruTtlCache<std::string, std::vector<std::string>, ManualClock>;
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " [--trace=FILE | --names=N --zipf=S --qps=R --duration=SEC --unique=FRACTION]\n"
+              << "         [--sizes=N,...] [--mem=SIZE,...] [--policies=lru,tinylfu] [--ttl=SEC] [--seed=N] [--jobs=N]\n"
+              << "         [--cname=FRACTION --cname-targets=N --cname-ttl=SEC] [--cname-cache=links,flat]\n"
+              << "Examples:\n"
+              << "  " << prog_name << " --names=1000000 --zipf=0.9 --qps=1000 --duration=86400 --sizes=10k,100k,1M\n"
+              << "  " << prog_name << " --trace=queries.txt --mem=16M,64M,256M\n"
+              << "  " << prog_name << " --cname=0.5 --cname-ttl=20 --cname-cache=links,flat --policies=lru\n";
+}
+
+// "100k" -> 100000, "64M" -> 64 << 20 (with base 1024); 0 on malformed input
+static size_t parse_size(const std::string &s, size_t base)
+{
+    char *end = nullptr;
+    double n = std::strtod(s.c_str(), &end);
+    if (end == s.c_str() || n < 0)
+        return 0;
+    switch (*end)
+    {
+    case 'K': case 'k': n *= double(base); ++end; break;
+    case 'M': case 'm': n *= double(base) * double(base); ++end; break;
+    case 'G': case 'g': n *= double(base) * double(base) * double(base); ++end; break;
+    default: break;
+    }
+    return *end == '\0' ? static_cast<size_t>(n) : 0;
+}
+
+static std::vector<std::string> split_list(const std::string &s)
+{
+    std::vector<std::string> out;
+    std::stringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ','))
+        if (!item.empty())
+            out.push_back(item);
+    return out;
+}
+
+struct SimQuery
+{
+    double time = 0; // seconds since the start of the trace
+    uint32_t key = 0; // index into the name table
+    uint32_t ttl = 0;
+    uint16_t qtype = 1;
+};
+
+// Position in a QuerySource; one per simulation so they can run in parallel
+struct SimCursor
+{
+    size_t next = 0;
+    std::mt19937_64 rng;
+    std::string scratch_name; // the current one-off name
+};
+
+// The same query stream for every configuration: either a loaded trace or
+// a seeded generator. Read-only once built; all state is in the cursor.
+class QuerySource
+{
+public:
+    bool load(const std::string &path, uint32_t default_ttl)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            std::cerr << "Cannot read trace " << path << "\n";
+            return false;
+        }
+        std::unordered_map<std::string, uint32_t> ids; // name -> index
+        std::string line;
+        size_t line_no = 0;
+        while (std::getline(in, line))
+        {
+            ++line_no;
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream fields(line);
+            SimQuery q;
+            std::string name;
+            unsigned qtype = 1;
+            q.ttl = default_ttl;
+            if (!(fields >> q.time >> name))
+            {
+                std::cerr << path << ":" << line_no << ": expected \"<seconds> <name> [qtype] [ttl]\"\n";
+                return false;
+            }
+            fields >> qtype >> q.ttl;
+            q.qtype = static_cast<uint16_t>(qtype);
+            auto it = ids.emplace(name, static_cast<uint32_t>(names_.size())).first;
+            if (it->second == names_.size())
+                names_.push_back(name);
+            q.key = it->second;
+            trace_.push_back(q);
+        }
+        if (trace_.empty())
+        {
+            std::cerr << "Trace " << path << " has no queries.\n";
+            return false;
+        }
+        duration_ = std::max(trace_.back().time, 1.0);
+        return true;
+    }
+
+    void synthesize(size_t names, double zipf, double qps, double duration, double unique,
+                    uint32_t fixed_ttl, uint64_t seed)
+    {
+        synthetic_ = true;
+        qps_ = qps;
+        total_ = static_cast<size_t>(qps * duration);
+        duration_ = duration;
+        unique_ = unique;
+        seed_ = seed;
+
+        // Zipf CDF over ranks; popular names get mixed TTLs unless one is fixed
+        cdf_.resize(names);
+        double sum = 0;
+        for (size_t r = 0; r < names; ++r)
+        {
+            sum += 1.0 / std::pow(double(r + 1), zipf);
+            cdf_[r] = sum;
+        }
+        for (double &c : cdf_)
+            c /= sum;
+
+        static constexpr uint32_t TTL_MIX[10] = {30, 60, 60, 300, 300, 300, 300, 3600, 3600, 86400};
+        std::mt19937_64 rng(seed ^ 0x5bd1e995);
+        names_.reserve(names);
+        ttls_.reserve(names + 1);
+        for (size_t r = 0; r < names; ++r)
+        {
+            names_.push_back("n" + std::to_string(r) + ".sim");
+            ttls_.push_back(fixed_ttl ? fixed_ttl : TTL_MIX[rng() % 10]);
+        }
+        ttls_.push_back(fixed_ttl ? fixed_ttl : 300); // one-off names
+    }
+
+    // Makes `fraction` of the synthetic names CNAMEs for one of `targets`
+    // shared names whose addresses have TTL `target_ttl`; the name's own TTL
+    // becomes the link's
+    void add_aliases(double fraction, size_t targets, uint32_t target_ttl)
+    {
+        target_ttl_ = target_ttl;
+        for (size_t t = 0; t < targets; ++t)
+            targets_.push_back("t" + std::to_string(t) + ".cdn.sim");
+        std::mt19937_64 rng(seed_ ^ 0xc2b2ae35);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        alias_.assign(names_.size(), NO_ALIAS);
+        for (uint32_t &a : alias_)
+        {
+            if (uniform(rng) < fraction)
+                a = static_cast<uint32_t>(rng() % targets);
+        }
+    }
+
+    SimCursor start() const
+    {
+        SimCursor c;
+        c.rng.seed(seed_);
+        return c;
+    }
+
+    bool next(SimCursor &c, SimQuery &q) const
+    {
+        if (!synthetic_)
+        {
+            if (c.next >= trace_.size())
+                return false;
+            q = trace_[c.next++];
+            return true;
+        }
+
+        if (c.next >= total_)
+            return false;
+        q.time = double(c.next++) / qps_;
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        if (unique_ > 0 && uniform(c.rng) < unique_)
+        {
+            // A name never seen again (scan / random subdomain)
+            q.key = static_cast<uint32_t>(cdf_.size());
+            c.scratch_name = "u" + std::to_string(c.next) + ".sim";
+        }
+        else
+        {
+            size_t rank = std::lower_bound(cdf_.begin(), cdf_.end(), uniform(c.rng)) - cdf_.begin();
+            q.key = static_cast<uint32_t>(std::min(rank, cdf_.size() - 1));
+        }
+        q.ttl = ttls_[q.key];
+        return true;
+    }
+
+    const std::string &name(const SimCursor &c, uint32_t id) const
+    {
+        return id < names_.size() ? names_[id] : c.scratch_name;
+    }
+    // The CNAME target of name `id`, or nullptr
+    const std::string *alias_target(uint32_t id) const
+    {
+        return id < alias_.size() && alias_[id] != NO_ALIAS ? &targets_[alias_[id]] : nullptr;
+    }
+    uint32_t target_ttl() const { return target_ttl_; }
+    size_t queries() const { return synthetic_ ? total_ : trace_.size(); }
+    double duration() const { return duration_; }
+
+private:
+    bool synthetic_ = false;
+    std::vector<SimQuery> trace_;
+    static constexpr uint32_t NO_ALIAS = UINT32_MAX;
+
+    std::vector<std::string> names_;
+    std::vector<uint32_t> ttls_;
+    std::vector<uint32_t> alias_; // per name: index into targets_ or NO_ALIAS
+    std::vector<std::string> targets_;
+    uint32_t target_ttl_ = 0;
+    std::vector<double> cdf_;
+    size_t total_ = 0;
+    double qps_ = 0;
+    double duration_ = 1;
+    double unique_ = 0;
+    uint64_t seed_ = 1;
+};
+
+struct SimResult
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t entries = 0;
+    size_t peak_bytes = 0;
+    double seconds = 0; // wall-clock time of the replay
+};
+
+// Runs on its own thread; ManualClock time is per thread
+static SimResult simulate(const QuerySource &src, size_t capacity, CachePolicy policy, CacheLimit limit,
+                          bool flatten)
+{
+    SimCache cache(capacity, policy, limit);
+    const ManualClock::time_point start{};
+    auto get = [&](const std::string &key, std::vector<std::string> &out, uint32_t &ttl_left, bool probe)
+    { return cache.get(key, out, ttl_left, probe); };
+    auto put = [&](const std::string &key, const std::vector<std::string> &val, uint32_t ttl)
+    { cache.put(key, val, ttl); };
+    std::vector<std::string> answers;
+    uint32_t ttl_left = 0;
+    ChainLookup look;
+    SimResult r;
+
+    auto wall = std::chrono::steady_clock::now();
+    SimCursor cursor = src.start();
+    SimQuery q;
+    while (src.next(cursor, q))
+    {
+        ManualClock::set(start + std::chrono::duration_cast<ManualClock::duration>(
+                                     std::chrono::duration<double>(q.time)));
+        const std::string &name = src.name(cursor, q.key);
+        bool hit = flatten ? get(cache_key(name, q.qtype), answers, ttl_left, false)
+                           : chain_get(name, q.qtype, get, answers, look);
+        if (hit)
+        {
+            r.hits++;
+            continue;
+        }
+        r.misses++;
+
+        // What the upstream returns for the name resolved (the target alone
+        // when the link was still cached)
+        DnsResult res;
+        res.answers.assign(1, "192.0.2." + std::to_string(q.key & 0xFF));
+        res.answer_ttl = res.min_ttl = q.ttl;
+        if (const std::string *target = src.alias_target(q.key))
+        {
+            res.answer_ttl = src.target_ttl();
+            res.min_ttl = std::min(q.ttl, res.answer_ttl);
+            if (flatten || look.links == 0)
+                res.chain.push_back(CnameLink{name, *target, q.ttl});
+        }
+
+        if (flatten)
+            put(cache_key(name, q.qtype), res.answers, res.min_ttl == 0 ? 60 : res.min_ttl);
+        else
+            chain_put(look.tail, q.qtype, res, put);
+    }
+
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+    r.entries = cache.size();
+    r.peak_bytes = cache.peak_bytes();
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string trace_path;
+    size_t names = 100000;
+    double zipf = 0.9;
+    double qps = 1000;
+    double duration = 3600;
+    double unique = 0;
+    uint32_t ttl = 0; // 0 = mixed TTLs (synthetic) / 300 (recorded)
+    double cname = 0;
+    size_t cname_targets = 100;
+    uint32_t cname_ttl = 20;
+    std::vector<std::string> cname_modes = {"links"};
+    uint64_t seed = 1;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> sizes, mems, policies = {"lru", "tinylfu"};
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--trace=", 8) == 0)
+            trace_path = argv[i] + 8;
+        else if (std::strncmp(argv[i], "--names=", 8) == 0)
+            names = std::max<size_t>(1, parse_size(argv[i] + 8, 1000));
+        else if (std::strncmp(argv[i], "--zipf=", 7) == 0)
+            zipf = std::atof(argv[i] + 7);
+        else if (std::strncmp(argv[i], "--qps=", 6) == 0)
+            qps = std::max(1.0, std::atof(argv[i] + 6));
+        else if (std::strncmp(argv[i], "--duration=", 11) == 0)
+            duration = std::max(1.0, std::atof(argv[i] + 11));
+        else if (std::strncmp(argv[i], "--unique=", 9) == 0)
+            unique = std::atof(argv[i] + 9);
+        else if (std::strncmp(argv[i], "--ttl=", 6) == 0)
+            ttl = static_cast<uint32_t>(std::strtoul(argv[i] + 6, nullptr, 10));
+        else if (std::strncmp(argv[i], "--seed=", 7) == 0)
+            seed = std::strtoull(argv[i] + 7, nullptr, 10);
+        else if (std::strncmp(argv[i], "--sizes=", 8) == 0)
+            sizes = split_list(argv[i] + 8);
+        else if (std::strncmp(argv[i], "--mem=", 6) == 0)
+            mems = split_list(argv[i] + 6);
+        else if (std::strncmp(argv[i], "--policies=", 11) == 0)
+            policies = split_list(argv[i] + 11);
+        else if (std::strncmp(argv[i], "--cname=", 8) == 0)
+            cname = std::atof(argv[i] + 8);
+        else if (std::strncmp(argv[i], "--cname-targets=", 16) == 0)
+            cname_targets = std::max<size_t>(1, parse_size(argv[i] + 16, 1000));
+        else if (std::strncmp(argv[i], "--cname-ttl=", 12) == 0)
+            cname_ttl = static_cast<uint32_t>(std::strtoul(argv[i] + 12, nullptr, 10));
+        else if (std::strncmp(argv[i], "--cname-cache=", 14) == 0)
+            cname_modes = split_list(argv[i] + 14);
+        else if (std::strncmp(argv[i], "--jobs=", 7) == 0)
+            jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[i] + 7)));
+        else
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (sizes.empty() && mems.empty())
+        sizes = {"1k", "10k", "100k"};
+
+    struct Config
+    {
+        size_t capacity;
+        CacheLimit limit;
+        CachePolicy policy;
+        bool flatten;
+        std::string label;
+    };
+    std::vector<Config> configs;
+    for (const auto &mode : cname_modes)
+    {
+        if (mode != "links" && mode != "flat")
+        {
+            std::cerr << "Error: Unsupported CNAME caching \"" << mode << "\".\n";
+            return EXIT_FAILURE;
+        }
+    }
+    for (const auto &p : policies)
+    {
+        if (p != "lru" && p != "tinylfu")
+        {
+            std::cerr << "Error: Unsupported cache policy \"" << p << "\".\n";
+            return EXIT_FAILURE;
+        }
+        CachePolicy policy = (p == "tinylfu") ? CachePolicy::WTinyLfu : CachePolicy::Lru;
+        for (const auto &mode : cname_modes)
+        {
+            bool flatten = (mode == "flat");
+            std::string suffix = cname > 0 ? (flatten ? ", flattened CNAMEs" : ", CNAME links") : "";
+            for (const auto &s : sizes)
+                configs.push_back({parse_size(s, 1000), CacheLimit::Entries, policy, flatten,
+                                   p + " " + s + " entries" + suffix});
+            for (const auto &m : mems)
+                configs.push_back({parse_size(m, 1024), CacheLimit::Bytes, policy, flatten,
+                                   p + " " + m + "B" + suffix});
+        }
+    }
+    for (const auto &c : configs)
+    {
+        if (c.capacity == 0)
+        {
+            std::cerr << "Error: Bad cache size in \"" << c.label << "\".\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    QuerySource src;
+    if (!trace_path.empty())
+    {
+        if (!src.load(trace_path, ttl ? ttl : 300))
+            return EXIT_FAILURE;
+    }
+    else
+    {
+        src.synthesize(names, zipf, qps, duration, unique, ttl, seed);
+        if (cname > 0)
+            src.add_aliases(cname, cname_targets, cname_ttl);
+    }
+
+    double span = src.duration();
+    std::cout << src.queries() << " queries over " << span << " s of virtual time ("
+              << double(src.queries()) / span << " QPS upstream without a cache)\n";
+    // Configurations are independent; up to `jobs` replay at once
+    std::vector<SimResult> results(configs.size());
+    std::atomic<size_t> next_config{0};
+    std::vector<std::thread> pool;
+    for (unsigned j = 0; j < std::min<size_t>(jobs, configs.size()); ++j)
+        pool.emplace_back([&]
+                          {
+            for (size_t i; (i = next_config.fetch_add(1)) < configs.size();)
+                results[i] = simulate(src, configs[i].capacity, configs[i].policy, configs[i].limit,
+                                      configs[i].flatten); });
+    for (auto &t : pool)
+        t.join();
+
+    for (size_t i = 0; i < configs.size(); ++i)
+    {
+        const Config &c = configs[i];
+        const SimResult &r = results[i];
+        size_t total = r.hits + r.misses;
+        std::cout << "  " << c.label << ": hit ratio " << (total ? 100.0 * double(r.hits) / double(total) : 0.0)
+                  << "%, upstream " << double(r.misses) / span
+                  << " QPS (saved " << double(r.hits) / span
+                  << "), peak " << (double(r.peak_bytes) / (1 << 20)) << " MiB, " << r.entries
+                  << " entries at end, " << (double(total) / r.seconds / 1e6) << " M queries/s\n";
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <poll.h>
+#include "dnsresolver.h"
+#include "dns_transport.h"
+
+// Example libdnsresolver client: resolves its arguments as one async batch
+// (waiting on the completion eventfd), then times cache hits through the
+// blocking call. --type=ADDR resolves both address families per name instead.
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " [--type=A|AAAA|ADDR|MX|CNAME] [--workers=N] [--hits=N] [--threads=N] [--no-l1]\n"
+              << "         [--replay=FILE] [--replay-latency=recorded|zero] <domain>...\n"
+              << "Examples:\n"
+              << "  " << prog_name << " example.com example.org github.com\n"
+              << "  " << prog_name << " --replay=example.cap --replay-latency=zero --hits=1000000 example.com\n";
+}
+
+static uint16_t qtype_string_to_code(const std::string &qtype_str)
+{
+    if (qtype_str == "A")
+        return 1;
+    if (qtype_str == "AAAA")
+        return 28;
+    if (qtype_str == "MX")
+        return 15;
+    if (qtype_str == "CNAME")
+        return 5;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t qtype = 1;
+    bool dual_stack = false;
+    DnsResolverOptions opts;
+    size_t hit_rounds = 0;
+    unsigned hit_threads = 1;
+    std::string replay_path;
+    bool replay_zero_latency = false;
+    std::vector<DnsQuery> queries;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--type=", 7) == 0)
+        {
+            dual_stack = std::strcmp(argv[i] + 7, "ADDR") == 0;
+            qtype = dual_stack ? 1 : qtype_string_to_code(argv[i] + 7);
+            if (qtype == 0)
+            {
+                std::cerr << "Error: Unsupported record type \"" << (argv[i] + 7) << "\".\n";
+                return EXIT_FAILURE;
+            }
+        }
+        else if (std::strncmp(argv[i], "--workers=", 10) == 0)
+        {
+            opts.workers = static_cast<unsigned>(std::max(1, std::atoi(argv[i] + 10)));
+        }
+        else if (std::strncmp(argv[i], "--hits=", 7) == 0)
+        {
+            hit_rounds = std::strtoull(argv[i] + 7, nullptr, 10);
+        }
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            hit_threads = static_cast<unsigned>(std::max(1, std::atoi(argv[i] + 10)));
+        }
+        else if (std::strcmp(argv[i], "--no-l1") == 0)
+        {
+            opts.hot_cache = false;
+        }
+        else if (std::strncmp(argv[i], "--replay=", 9) == 0)
+        {
+            replay_path = argv[i] + 9;
+        }
+        else if (std::strcmp(argv[i], "--replay-latency=zero") == 0)
+        {
+            replay_zero_latency = true;
+        }
+        else if (std::strcmp(argv[i], "--replay-latency=recorded") == 0)
+        {
+            replay_zero_latency = false;
+        }
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            queries.push_back(DnsQuery{argv[i], 0});
+        }
+    }
+
+    if (queries.empty())
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (auto &q : queries)
+        q.qtype = qtype;
+
+    if (!replay_path.empty() && !transport_start_replay(replay_path, replay_zero_latency))
+        return EXIT_FAILURE;
+
+    using Clock = std::chrono::steady_clock;
+    DnsResolver resolver(opts);
+    std::vector<std::string> names;
+    for (const auto &q : queries)
+        names.push_back(q.name);
+
+    if (dual_stack)
+    {
+        auto print = [](const DnsAnswer &a)
+        {
+            std::cout << " " << (a.qtype == 1 ? "A" : "AAAA") << (a.cached ? "(cached)" : "") << ":";
+            if (a.nxdomain)
+                std::cout << " NXDOMAIN";
+            for (const auto &ans : a.answers)
+                std::cout << " " << ans;
+        };
+        for (const auto &name : names)
+        {
+            auto start = Clock::now();
+            DnsAddresses r = resolver.resolve_addresses(name);
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+            std::cout << name << ":";
+            print(r.a);
+            print(r.aaaa);
+            std::cout << " in " << us << " us\n";
+        }
+        transport_stop();
+        return EXIT_SUCCESS;
+    }
+
+    auto start = Clock::now();
+    resolver.submit(std::move(queries));
+
+    std::vector<DnsBatch> done;
+    pollfd pfd{resolver.completion_fd(), POLLIN, 0};
+    while (done.empty())
+    {
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        {
+            std::cerr << "poll failed: " << std::strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+        resolver.take_completed(done);
+    }
+    auto batch_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+    for (const auto &a : done.front().results)
+    {
+        std::cout << a.name << ":";
+        if (a.nxdomain)
+            std::cout << " NXDOMAIN";
+        for (const auto &ans : a.answers)
+            std::cout << " " << ans;
+        std::cout << " (ttl=" << a.ttl << "s)\n";
+    }
+    std::cout << "Batch of " << done.front().results.size() << " resolved in " << batch_us << " us\n";
+
+    if (hit_rounds > 0)
+    {
+        // Each thread loops over the batch's names through the blocking call
+        std::vector<std::thread> threads;
+        start = Clock::now();
+        for (unsigned t = 0; t < hit_threads; ++t)
+            threads.emplace_back([&, t]
+                                 {
+                for (size_t i = 0; i < hit_rounds; ++i)
+                    resolver.resolve(names[(i + t) % names.size()], qtype);
+            });
+        for (auto &th : threads)
+            th.join();
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        size_t total = hit_rounds * hit_threads;
+        std::cout << total << " blocking lookups on " << hit_threads << " thread(s): "
+                  << (double(ns) / double(total)) << " ns per lookup\n";
+    }
+    std::cout << "L1 hits=" << resolver.l1_hits() << " L2 hits=" << resolver.cache_hits()
+              << " misses=" << resolver.cache_misses() << "\n";
+
+    transport_stop();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include "blocklist.h"
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " -o <image> <blocklist-file>...\n"
+              << "Examples:\n"
+              << "  " << prog_name << " -o block.bimg ads.hosts trackers.txt\n";
+}
+
+int main(int argc, char *argv[])
+{
+    std::string out_path;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            inputs.emplace_back(argv[i]);
+        }
+    }
+
+    if (out_path.empty() || inputs.empty())
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+
+    std::vector<std::string> domains;
+    for (const auto &path : inputs)
+    {
+        if (!parse_blocklist_source(path, domains))
+            return EXIT_FAILURE;
+    }
+
+    if (!compile_blocklist_image(domains, out_path))
+        return EXIT_FAILURE;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    Blocklist check;
+    if (!check.open(out_path))
+        return EXIT_FAILURE;
+
+    double per_million = check.domain_count()
+                             ? double(check.image_bytes()) * 1e6 / double(check.domain_count()) / (1024 * 1024)
+                             : 0.0;
+    std::cout << "Compiled " << domains.size() << " entries into " << check.domain_count()
+              << " blocked suffixes, " << check.node_count() << " nodes, "
+              << check.image_bytes() << " bytes (" << per_million << " MiB per million) in "
+              << ms << " ms\n";
+    return EXIT_SUCCESS;
+}
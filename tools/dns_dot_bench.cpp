@@ -0,0 +1,363 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include "dns_client.h"
+#include "dns_dot.h"
+#include "dns_packet.h"
+
+// Cost per upstream query over UDP and over DNS-over-TLS, measured through
+// send_query/recv_response against local stand-in servers (a UDP one and a
+// TLS one on 127.0.0.1, both answering every question with a fixed record).
+//
+// --rtt=MS emulates network distance: each reply is held back for one RTT,
+// and the TLS stand-in holds back its first handshake flight for two (one for
+// the TCP handshake, one for TLS), as a real upstream would cost.
+
+using Clock = std::chrono::steady_clock;
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " [--queries=N] [--depth=N] [--threads=N] [--rtt=MS]\n"
+              << "Examples:\n"
+              << "  " << prog_name << " --queries=2000\n"
+              << "  " << prog_name << " --queries=50 --rtt=10\n";
+}
+
+// Self-signed P-256 certificate for "localhost" / 127.0.0.1
+static bool make_certificate(EVP_PKEY *&key, X509 *&cert)
+{
+    key = EVP_EC_gen("P-256");
+    cert = X509_new();
+    if (!key || !cert)
+        return false;
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    X509V3_CTX v3;
+    X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+    X509_EXTENSION *san = X509V3_EXT_conf_nid(nullptr, &v3, NID_subject_alt_name,
+                                              "DNS:localhost,IP:127.0.0.1");
+    if (!san)
+        return false;
+    X509_add_ext(cert, san, -1);
+    X509_EXTENSION_free(san);
+    return X509_sign(cert, key, EVP_sha256()) > 0;
+}
+
+static int listen_loopback(int type, uint16_t &port)
+{
+    int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), len) < 0 ||
+        (type == SOCK_STREAM && listen(fd, 128) < 0) ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) < 0)
+    {
+        std::cerr << "Cannot open a loopback socket: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static bool stand_in_answer(const uint8_t *query, size_t len, std::vector<uint8_t> &out)
+{
+    std::string name;
+    uint16_t qtype = 0;
+    if (!parse_query_question(query, len, name, qtype))
+        return false;
+    std::vector<std::string> answers;
+    if (qtype == 1)
+        answers.emplace_back("192.0.2.1");
+    else if (qtype == 28)
+        answers.emplace_back("2001:db8::1");
+    return build_response_packet(query, len, qtype, answers, 300, 0, out);
+}
+
+static void serve_udp(int fd, std::chrono::microseconds rtt, std::atomic<bool> &stop)
+{
+    uint8_t buf[512];
+    std::vector<uint8_t> reply;
+    while (!stop.load())
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&from), &from_len);
+        if (n <= 0 || !stand_in_answer(buf, static_cast<size_t>(n), reply))
+            continue;
+        std::this_thread::sleep_for(rtt);
+        sendto(fd, reply.data(), reply.size(), 0, reinterpret_cast<sockaddr *>(&from), from_len);
+    }
+}
+
+static std::atomic<int> g_live_connections{0};
+
+// One TLS client connection. Reads frames as they arrive and sends each reply
+// once its RTT has passed, so pipelined queries overlap like on a network.
+static void serve_tls_connection(SSL_CTX *ctx, int fd, std::chrono::microseconds rtt)
+{
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::this_thread::sleep_for(2 * rtt); // TCP + TLS round trips before ServerHello
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) != 1)
+    {
+        SSL_free(ssl);
+        close(fd);
+        g_live_connections--;
+        return;
+    }
+
+    std::deque<std::pair<Clock::time_point, std::vector<uint8_t>>> due;
+    std::vector<uint8_t> rx, reply;
+    uint8_t buf[4096];
+    for (;;)
+    {
+        int timeout = -1;
+        if (!due.empty())
+            timeout = static_cast<int>(std::max<int64_t>(
+                0, std::chrono::duration_cast<std::chrono::milliseconds>(due.front().first - Clock::now()).count()));
+        pollfd pfd{fd, POLLIN, 0};
+        if (SSL_pending(ssl) == 0 && poll(&pfd, 1, timeout) > 0)
+        {
+            int n = SSL_read(ssl, buf, sizeof(buf));
+            if (n <= 0)
+                break; // client closed
+            rx.insert(rx.end(), buf, buf + n);
+            size_t pos = 0;
+            while (rx.size() - pos >= 2)
+            {
+                size_t len = (size_t(rx[pos]) << 8) | rx[pos + 1];
+                if (rx.size() - pos - 2 < len)
+                    break;
+                if (stand_in_answer(rx.data() + pos + 2, len, reply))
+                {
+                    std::vector<uint8_t> frame{uint8_t(reply.size() >> 8), uint8_t(reply.size())};
+                    frame.insert(frame.end(), reply.begin(), reply.end());
+                    due.emplace_back(Clock::now() + rtt, std::move(frame));
+                }
+                pos += 2 + len;
+            }
+            rx.erase(rx.begin(), rx.begin() + pos);
+        }
+        while (!due.empty() && due.front().first <= Clock::now())
+        {
+            SSL_write(ssl, due.front().second.data(), static_cast<int>(due.front().second.size()));
+            due.pop_front();
+        }
+    }
+    SSL_free(ssl);
+    close(fd);
+    g_live_connections--;
+}
+
+struct ModeResult
+{
+    double us_per_query = 0;
+    size_t failed = 0;
+    DotStats dot;
+};
+
+// Each thread sends `depth` queries before reading the first reply
+static ModeResult run_mode(const std::string &server, uint16_t port, size_t queries, size_t depth,
+                           unsigned threads)
+{
+    std::atomic<size_t> failed{0};
+    auto worker = [&](size_t first, size_t count)
+    {
+        std::vector<std::vector<uint8_t>> packets(depth);
+        std::vector<int> handles(depth);
+        for (size_t done = 0; done < count;)
+        {
+            size_t n = std::min(depth, count - done);
+            for (size_t i = 0; i < n; ++i)
+            {
+                packets[i] = build_query_packet("q" + std::to_string(first + done + i) + ".bench", 1);
+                handles[i] = send_query(packets[i], server, port);
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (handles[i] < 0 || recv_response(handles[i], 3).empty())
+                    failed++;
+            }
+            done += n;
+        }
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> pool;
+    size_t per_thread = queries / threads;
+    for (unsigned t = 0; t < threads; ++t)
+        pool.emplace_back(worker, t * per_thread, t + 1 == threads ? queries - t * per_thread : per_thread);
+    for (auto &th : pool)
+        th.join();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+    ModeResult r;
+    r.us_per_query = double(us) / double(queries);
+    r.failed = failed.load();
+    r.dot = dot_stats();
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t queries = 1000;
+    size_t depth = 16;
+    unsigned threads = 4;
+    std::chrono::microseconds rtt{0};
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--queries=", 10) == 0)
+            queries = std::max<size_t>(1, std::strtoull(argv[i] + 10, nullptr, 10));
+        else if (std::strncmp(argv[i], "--depth=", 8) == 0)
+            depth = std::max<size_t>(1, std::strtoull(argv[i] + 8, nullptr, 10));
+        else if (std::strncmp(argv[i], "--threads=", 10) == 0)
+            threads = static_cast<unsigned>(std::max(1, std::atoi(argv[i] + 10)));
+        else if (std::strncmp(argv[i], "--rtt=", 6) == 0)
+            rtt = std::chrono::microseconds(static_cast<int64_t>(std::atof(argv[i] + 6) * 1000));
+        else
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Stand-in servers
+    EVP_PKEY *key = nullptr;
+    X509 *cert = nullptr;
+    if (!make_certificate(key, cert))
+    {
+        std::cerr << "Cannot create the stand-in certificate.\n";
+        return EXIT_FAILURE;
+    }
+    char ca_path[] = "/tmp/dns_dot_bench_XXXXXX";
+    int ca_fd = mkstemp(ca_path);
+    FILE *ca = ca_fd >= 0 ? fdopen(ca_fd, "w") : nullptr;
+    if (!ca || PEM_write_X509(ca, cert) != 1)
+    {
+        std::cerr << "Cannot write the stand-in certificate.\n";
+        return EXIT_FAILURE;
+    }
+    fclose(ca);
+
+    SSL_CTX *server_ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate(server_ctx, cert);
+    SSL_CTX_use_PrivateKey(server_ctx, key);
+
+    uint16_t udp_port = 0, tls_port = 0;
+    int udp_fd = listen_loopback(SOCK_DGRAM, udp_port);
+    int tls_fd = listen_loopback(SOCK_STREAM, tls_port);
+    if (udp_fd < 0 || tls_fd < 0)
+        return EXIT_FAILURE;
+
+    std::atomic<bool> stop{false};
+    std::thread udp_thread(serve_udp, udp_fd, rtt, std::ref(stop));
+    std::thread accept_thread([&]
+                              {
+        for (;;)
+        {
+            int fd = accept4(tls_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+                return; // listener shut down
+            g_live_connections++;
+            std::thread(serve_tls_connection, server_ctx, fd, rtt).detach();
+        } });
+
+    struct Mode
+    {
+        const char *label;
+        bool dot;
+        bool reuse;
+        bool tickets;
+        size_t depth;
+        unsigned threads;
+    };
+    const Mode modes[] = {
+        {"udp", false, false, false, 1, 1},
+        {"dot, new connection per query", true, false, false, 1, 1},
+        {"dot, new connection, resumed", true, false, true, 1, 1},
+        {"dot, persistent connection", true, true, true, 1, 1},
+        {"dot, persistent, pipelined", true, true, true, depth, 1},
+        {"dot, persistent, shared by threads", true, true, true, 1, threads},
+    };
+
+    std::cout << queries << " queries per mode, rtt=" << rtt.count() / 1000.0 << " ms\n";
+    for (const Mode &m : modes)
+    {
+        uint16_t port = udp_port;
+        if (m.dot)
+        {
+            DotOptions opts;
+            opts.port = tls_port;
+            opts.ca_file = ca_path;
+            opts.server_name = "localhost";
+            opts.reuse_connections = m.reuse;
+            opts.session_tickets = m.tickets;
+            if (!dot_enable(opts))
+                return EXIT_FAILURE;
+        }
+        ModeResult r = run_mode("127.0.0.1", port, queries, m.depth, m.threads);
+        dot_disable();
+
+        std::cout << "  " << m.label;
+        if (m.depth > 1)
+            std::cout << " x" << m.depth;
+        if (m.threads > 1)
+            std::cout << " x" << m.threads;
+        std::cout << ": " << r.us_per_query << " us/query";
+        if (m.dot)
+            std::cout << " handshakes=" << r.dot.handshakes
+                      << " resumed=" << r.dot.resumed
+                      << " max_pipelined=" << r.dot.max_in_flight;
+        if (r.failed)
+            std::cout << " failed=" << r.failed;
+        std::cout << "\n";
+    }
+
+    stop = true;
+    shutdown(tls_fd, SHUT_RDWR);
+    accept_thread.join();
+    udp_thread.join();
+    while (g_live_connections.load() > 0) // clients are gone; let the handlers finish
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    SSL_CTX_free(server_ctx);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    close(tls_fd);
+    close(udp_fd);
+    std::remove(ca_path);
+    return EXIT_SUCCESS;
+}
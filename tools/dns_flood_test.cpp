@@ -0,0 +1,274 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "dnsresolver.h"
+#include "dns_packet.h"
+#include "resolver.h"
+
+// Load test for the flood guard. A stand-in authoritative server on
+// 127.0.0.1 knows --legit names under victim.example and answers NXDOMAIN
+// for anything else. A warm-up pass resolves the real names once (normal
+// traffic before the attack). Then a flood of random <label>.victim.example
+// names, mixed with real ones, goes through DnsResolver::submit. The run is
+// done with the guard off and on. --auth-us makes the stand-in spend that
+// long on each query, one at a time, like an authority with limited capacity.
+
+using Clock = std::chrono::steady_clock;
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " [--legit=N] [--flood=N] [--legit-share=F] [--ttl=SEC] [--auth-us=N]\n"
+              << "         [--batch=N] [--workers=N] [--labels=N] [--guard=off,on]\n"
+              << "Example:\n"
+              << "  " << prog_name << " --legit=1000 --flood=100000 --legit-share=0.05 --auth-us=50\n";
+}
+
+struct StandIn
+{
+    int fd = -1;
+    uint16_t port = 0;
+    std::unordered_set<std::string> names;
+    uint32_t ttl = 1;
+    std::chrono::microseconds service_time{0};
+    std::atomic<uint64_t> queries{0};
+    std::atomic<bool> stop{false};
+};
+
+static void serve_stand_in(StandIn &s)
+{
+    uint8_t buf[512];
+    std::vector<uint8_t> reply;
+    std::string name;
+    std::vector<std::string> answers;
+    while (!s.stop.load())
+    {
+        pollfd pfd{s.fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+        sockaddr_in from{};
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(s.fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&from), &from_len);
+        uint16_t qtype = 0;
+        if (n <= 0 || !parse_query_question(buf, static_cast<size_t>(n), name, qtype))
+            continue;
+        s.queries++;
+        if (s.service_time.count() > 0)
+        {
+            auto until = Clock::now() + s.service_time;
+            while (Clock::now() < until)
+            {
+            } // busy, as an overloaded server would be
+        }
+
+        answers.clear();
+        bool exists = s.names.count(name) > 0;
+        if (exists && qtype == 1)
+            answers.emplace_back("192.0.2.1");
+        if (!build_response_packet(buf, static_cast<size_t>(n), qtype, answers, s.ttl, exists ? 0 : 3, reply))
+            continue;
+        sendto(s.fd, reply.data(), reply.size(), 0, reinterpret_cast<sockaddr *>(&from), from_len);
+    }
+}
+
+struct RunResult
+{
+    double seconds = 0;
+    uint64_t upstream = 0;
+    size_t legit = 0, legit_ok = 0, legit_nx = 0;
+    size_t flood = 0, flood_shed = 0;
+    DnsFloodStats guard;
+};
+
+// Submits one batch and waits for it
+static void resolve_batch(DnsResolver &resolver, std::vector<DnsQuery> queries, std::vector<DnsAnswer> &out)
+{
+    std::mutex m;
+    std::condition_variable cv;
+    bool done = false;
+    resolver.submit(std::move(queries), [&](DnsBatch &b)
+                    {
+        std::lock_guard<std::mutex> lock(m);
+        out = std::move(b.results);
+        done = true;
+        cv.notify_one(); });
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [&]
+            { return done; });
+}
+
+static RunResult run(StandIn &s, const std::vector<std::string> &legit, size_t flood, double legit_share,
+                     size_t batch, unsigned workers, int labels, bool guard)
+{
+    DnsResolverOptions opts;
+    opts.workers = workers;
+    opts.flood_guard = guard;
+    opts.cache_entries = 4 * legit.size() + 1024;
+    DnsResolver resolver(opts);
+    std::vector<DnsAnswer> results;
+
+    // Warm-up: every real name resolved once, then left to expire
+    for (size_t i = 0; i < legit.size(); i += batch)
+    {
+        std::vector<DnsQuery> qs;
+        for (size_t j = i; j < std::min(legit.size(), i + batch); ++j)
+            qs.push_back(DnsQuery{legit[j], 1});
+        resolve_batch(resolver, std::move(qs), results);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000 * s.ttl + 100));
+
+    RunResult r;
+    std::mt19937_64 rng(42); // the same flood for every run
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    uint64_t upstream_before = s.queries.load();
+    auto start = Clock::now();
+    for (size_t sent = 0; sent < flood;)
+    {
+        std::vector<DnsQuery> qs;
+        std::vector<bool> is_legit;
+        for (; qs.size() < batch && sent < flood; ++sent)
+        {
+            bool real = uniform(rng) < legit_share;
+            is_legit.push_back(real);
+            if (real)
+                qs.push_back(DnsQuery{legit[rng() % legit.size()], 1});
+            else
+            {
+                std::string qname;
+                for (int l = 0; l < labels; ++l)
+                {
+                    char label[18];
+                    std::snprintf(label, sizeof(label), "%016llx.", static_cast<unsigned long long>(rng()));
+                    qname += label;
+                }
+                qs.push_back(DnsQuery{qname + "victim.example", 1});
+            }
+        }
+        resolve_batch(resolver, std::move(qs), results);
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const DnsAnswer &a = results[i];
+            if (is_legit[i])
+            {
+                r.legit++;
+                r.legit_ok += !a.answers.empty();
+                r.legit_nx += a.nxdomain;
+            }
+            else
+            {
+                r.flood++;
+                r.flood_shed += a.shed;
+            }
+        }
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.upstream = s.queries.load() - upstream_before;
+    r.guard = resolver.flood_stats();
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t legit_count = 1000;
+    size_t flood = 100000;
+    double legit_share = 0.05;
+    uint32_t ttl = 1;
+    int auth_us = 0;
+    size_t batch = 64;
+    unsigned workers = 4;
+    int labels = 1; // random labels in front of victim.example
+    std::vector<bool> guard_modes = {false, true};
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--legit=", 8) == 0)
+            legit_count = std::max(1, std::atoi(argv[i] + 8));
+        else if (std::strncmp(argv[i], "--flood=", 8) == 0)
+            flood = static_cast<size_t>(std::max(1, std::atoi(argv[i] + 8)));
+        else if (std::strncmp(argv[i], "--legit-share=", 14) == 0)
+            legit_share = std::atof(argv[i] + 14);
+        else if (std::strncmp(argv[i], "--ttl=", 6) == 0)
+            ttl = static_cast<uint32_t>(std::max(1, std::atoi(argv[i] + 6)));
+        else if (std::strncmp(argv[i], "--auth-us=", 10) == 0)
+            auth_us = std::max(0, std::atoi(argv[i] + 10));
+        else if (std::strncmp(argv[i], "--batch=", 8) == 0)
+            batch = static_cast<size_t>(std::max(1, std::atoi(argv[i] + 8)));
+        else if (std::strncmp(argv[i], "--workers=", 10) == 0)
+            workers = static_cast<unsigned>(std::max(1, std::atoi(argv[i] + 10)));
+        else if (std::strncmp(argv[i], "--labels=", 9) == 0)
+            labels = std::max(1, std::atoi(argv[i] + 9));
+        else if (std::strcmp(argv[i], "--guard=off") == 0)
+            guard_modes = {false};
+        else if (std::strcmp(argv[i], "--guard=on") == 0)
+            guard_modes = {true};
+        else if (std::strcmp(argv[i], "--guard=off,on") == 0)
+            guard_modes = {false, true};
+        else
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    StandIn s;
+    s.ttl = ttl;
+    s.service_time = std::chrono::microseconds(auth_us);
+    std::vector<std::string> legit;
+    for (size_t i = 0; i < legit_count; ++i)
+    {
+        legit.push_back("host" + std::to_string(i) + ".victim.example");
+        s.names.insert(legit.back());
+    }
+
+    s.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (s.fd < 0 || bind(s.fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        getsockname(s.fd, reinterpret_cast<sockaddr *>(&addr), &addr_len) < 0)
+    {
+        std::cerr << "Cannot open the stand-in server: " << std::strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    s.port = ntohs(addr.sin_port);
+    std::thread server([&]
+                       { serve_stand_in(s); });
+    set_upstream_servers({"127.0.0.1"}, s.port);
+
+    std::cout << flood << " queries, " << (legit_share * 100) << "% for " << legit_count
+              << " real names (ttl " << ttl << "s), the rest random under victim.example; stand-in takes "
+              << auth_us << " us per query\n";
+    for (bool guard : guard_modes)
+    {
+        RunResult r = run(s, legit, flood, legit_share, batch, workers, labels, guard);
+        std::cout << "  guard " << (guard ? "on: " : "off:") << " " << (double(flood) / r.seconds)
+                  << " queries/s, upstream queries " << r.upstream
+                  << ", flood shed " << (r.flood ? 100.0 * double(r.flood_shed) / double(r.flood) : 0.0)
+                  << "%, real names answered " << r.legit_ok << "/" << r.legit
+                  << " (NXDOMAIN " << r.legit_nx << ")";
+        if (guard)
+            std::cout << ", probes " << r.guard.probes << ", zones defended " << r.guard.triggers;
+        std::cout << "\n";
+    }
+
+    s.stop = true;
+    server.join();
+    close(s.fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "dns_packet.h"
+
+// UDP load generator for serve mode. Sends queries open-loop at a fixed rate
+// (or, with --rate=0, as fast as a window of in-flight queries allows) and
+// reports replies per second, loss and latency percentiles.
+
+constexpr unsigned BATCH = 64;
+constexpr unsigned FLOOD_WINDOW = 512; // in-flight queries when --rate=0
+constexpr size_t LATENCY_BUCKETS = 100000; // 10 us each, up to 1 s
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " [--server=IP:PORT] [--rate=QPS] [--duration=SEC]\n"
+              << "         [--type=A|AAAA] [--names=FILE] [<domain>...]\n"
+              << "Examples:\n"
+              << "  " << prog_name << " --server=127.0.0.1:5353 --rate=50000 --duration=5 --names=names.txt\n"
+              << "  " << prog_name << " --rate=0 example.com\n";
+}
+
+int main(int argc, char *argv[])
+{
+    std::string server_ip = "127.0.0.1";
+    uint16_t server_port = 5353;
+    uint64_t rate = 10000;
+    double duration = 5.0;
+    uint16_t qtype = 1;
+    std::vector<std::string> names;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--server=", 9) == 0)
+        {
+            std::string s = argv[i] + 9;
+            size_t colon = s.rfind(':');
+            server_ip = s.substr(0, colon);
+            if (colon != std::string::npos)
+                server_port = static_cast<uint16_t>(std::atoi(s.c_str() + colon + 1));
+        }
+        else if (std::strncmp(argv[i], "--rate=", 7) == 0)
+            rate = std::strtoull(argv[i] + 7, nullptr, 10);
+        else if (std::strncmp(argv[i], "--duration=", 11) == 0)
+            duration = std::atof(argv[i] + 11);
+        else if (std::strcmp(argv[i], "--type=AAAA") == 0)
+            qtype = 28;
+        else if (std::strcmp(argv[i], "--type=A") == 0)
+            qtype = 1;
+        else if (std::strncmp(argv[i], "--names=", 8) == 0)
+        {
+            std::ifstream in(argv[i] + 8);
+            if (!in)
+            {
+                std::cerr << "Cannot read " << (argv[i] + 8) << "\n";
+                return EXIT_FAILURE;
+            }
+            std::string line;
+            while (std::getline(in, line))
+                if (!line.empty())
+                    names.push_back(line);
+        }
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+            names.emplace_back(argv[i]);
+    }
+    if (names.empty())
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    sockaddr_in server{};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(server_port);
+    if (inet_pton(AF_INET, server_ip.c_str(), &server.sin_addr) <= 0)
+    {
+        std::cerr << "Invalid server address " << server_ip << "\n";
+        return EXIT_FAILURE;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufsz = 8 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof(bufsz));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufsz, sizeof(bufsz));
+    if (connect(sock, reinterpret_cast<sockaddr *>(&server), sizeof(server)) < 0)
+    {
+        std::cerr << "connect failed: " << std::strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    timeval tv{0, 100000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    std::vector<std::vector<uint8_t>> packets;
+    for (const auto &n : names)
+        packets.push_back(build_query_packet(n, qtype));
+
+    using Clock = std::chrono::steady_clock;
+    const auto t0 = Clock::now();
+    auto now_ns = [&]()
+    { return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count()); };
+
+    // Send time per transaction ID (the ID is the low 16 bits of the sequence)
+    static std::atomic<uint64_t> sent_at[65536];
+    std::atomic<uint64_t> sent{0}, received{0};
+    std::atomic<bool> sending{true};
+    std::vector<uint32_t> latency(LATENCY_BUCKETS + 1, 0);
+
+    std::thread receiver([&]
+                         {
+        uint8_t bufs[BATCH][512];
+        iovec iov[BATCH];
+        mmsghdr msgs[BATCH];
+        uint64_t quiet_since = 0;
+        for (;;)
+        {
+            for (unsigned i = 0; i < BATCH; ++i)
+            {
+                iov[i] = {bufs[i], sizeof(bufs[i])};
+                msgs[i] = {};
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int n = recvmmsg(sock, msgs, BATCH, MSG_WAITFORONE, nullptr);
+            uint64_t now = now_ns();
+            if (n <= 0)
+            {
+                if (!sending.load())
+                {
+                    if (quiet_since == 0)
+                        quiet_since = now;
+                    else if (now - quiet_since > 500000000ULL || received.load() >= sent.load())
+                        break;
+                }
+                continue;
+            }
+            quiet_since = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                if (msgs[i].msg_len < 2)
+                    continue;
+                uint16_t id = static_cast<uint16_t>((bufs[i][0] << 8) | bufs[i][1]);
+                uint64_t us = (now - sent_at[id].load(std::memory_order_relaxed)) / 1000;
+                latency[std::min<uint64_t>(us / 10, LATENCY_BUCKETS)]++;
+            }
+            received += n;
+            if (!sending.load() && received.load() >= sent.load())
+                break;
+        } });
+
+    const uint64_t end_ns = static_cast<uint64_t>(duration * 1e9);
+    std::vector<std::vector<uint8_t>> out(BATCH);
+    iovec iov[BATCH];
+    mmsghdr msgs[BATCH];
+    uint64_t seq = 0;
+    for (;;)
+    {
+        uint64_t now = now_ns();
+        if (now >= end_ns)
+            break;
+
+        uint64_t due = rate ? now * rate / 1000000000ULL : received.load() + FLOOD_WINDOW;
+        if (due <= seq)
+        {
+            if (rate)
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            else
+                std::this_thread::yield();
+            continue;
+        }
+
+        unsigned n = static_cast<unsigned>(std::min<uint64_t>(due - seq, BATCH));
+        for (unsigned i = 0; i < n; ++i)
+        {
+            out[i] = packets[(seq + i) % packets.size()];
+            uint16_t id = static_cast<uint16_t>(seq + i);
+            out[i][0] = static_cast<uint8_t>(id >> 8);
+            out[i][1] = static_cast<uint8_t>(id);
+            sent_at[id].store(now, std::memory_order_relaxed);
+            iov[i] = {out[i].data(), out[i].size()};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int done = sendmmsg(sock, msgs, n, 0);
+        if (done > 0)
+        {
+            seq += done;
+            sent += done;
+        }
+    }
+    double send_secs = double(now_ns()) / 1e9;
+    sending = false;
+    receiver.join();
+    close(sock);
+
+    auto percentile = [&](double p)
+    {
+        uint64_t want = static_cast<uint64_t>(p * double(received.load()));
+        uint64_t acc = 0;
+        for (size_t b = 0; b <= LATENCY_BUCKETS; ++b)
+        {
+            acc += latency[b];
+            if (acc > want)
+                return b * 10;
+        }
+        return LATENCY_BUCKETS * 10;
+    };
+
+    uint64_t s = sent.load(), r = received.load();
+    std::cout << "target=" << (rate ? std::to_string(rate) : std::string("flood"))
+              << " sent=" << s << " received=" << r
+              << " loss=" << (s ? 100.0 * double(s - std::min(s, r)) / double(s) : 0.0) << "%"
+              << " replies/s=" << static_cast<uint64_t>(double(r) / send_secs)
+              << " p50=" << percentile(0.50) << "us p99=" << percentile(0.99)
+              << "us p99.9=" << percentile(0.999) << "us\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "dnsresolver.h"
+#include "dns_packet.h"
+#include "resolver.h"
+
+// Hit latency while misses wait on slow upstreams. One front-end thread, like
+// the serve-mode listener, issues queries on a fixed schedule (--rate): most
+// are for hot names already in the cache, --miss-share are new names that have
+// to go to a stand-in upstream on 127.0.0.1, which holds every reply back for
+// --upstream-ms. A hit's latency is counted from its scheduled time, so time
+// the front end spent on anything else shows up in it.
+//
+//   pool:   misses are handed to DnsResolver::submit and come back through
+//           completion_fd(); the front end only ever answers hits itself
+//   inline: the front end resolves each miss with the blocking resolve(), as
+//           a thread serving clients one by one would
+
+using Clock = std::chrono::steady_clock;
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " [--rate=N] [--duration=SEC] [--hot=N] [--miss-share=F]\n"
+              << "         [--upstream-ms=MS,...] [--workers=N] [--mode=pool,inline]\n"
+              << "Example:\n"
+              << "  " << prog_name << " --rate=5000 --miss-share=0.002 --upstream-ms=0,20,200,1000\n";
+}
+
+// Answers every A question with 192.0.2.1 (TTL 1h), `delay_us` after it
+// arrived; replies are held in a queue, so slow answers overlap like on a
+// network
+static void serve_stand_in(int fd, const std::atomic<int64_t> &delay_us, const std::atomic<bool> &stop)
+{
+    std::deque<std::pair<Clock::time_point, std::pair<sockaddr_in, std::vector<uint8_t>>>> due;
+    uint8_t buf[512];
+    std::string name;
+    const std::vector<std::string> answers = {"192.0.2.1"};
+    while (!stop.load())
+    {
+        int timeout = 100;
+        if (!due.empty())
+            timeout = static_cast<int>(std::clamp<int64_t>( // rounded up, not spinning for the last ms
+                std::chrono::ceil<std::chrono::milliseconds>(due.front().first - Clock::now()).count(), 0, 100));
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) > 0)
+        {
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr *>(&from), &from_len);
+            uint16_t qtype = 0;
+            std::vector<uint8_t> reply;
+            if (n > 0 && parse_query_question(buf, static_cast<size_t>(n), name, qtype) &&
+                build_response_packet(buf, static_cast<size_t>(n), qtype, qtype == 1 ? answers : std::vector<std::string>(),
+                                      3600, 0, reply))
+                due.emplace_back(Clock::now() + std::chrono::microseconds(delay_us.load()),
+                                 std::make_pair(from, std::move(reply)));
+        }
+        while (!due.empty() && due.front().first <= Clock::now())
+        {
+            const auto &r = due.front().second;
+            sendto(fd, r.second.data(), r.second.size(), 0, reinterpret_cast<const sockaddr *>(&r.first),
+                   sizeof(r.first));
+            due.pop_front();
+        }
+    }
+}
+
+struct Latencies
+{
+    std::vector<double> us;
+
+    double percentile(double p)
+    {
+        if (us.empty())
+            return 0;
+        size_t k = std::min(us.size() - 1, static_cast<size_t>(p * double(us.size())));
+        std::nth_element(us.begin(), us.begin() + k, us.end());
+        return us[k];
+    }
+};
+
+static double since_us(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+static void run(bool pool, size_t rate, double duration, size_t hot, double miss_share, unsigned workers,
+                unsigned upstream_ms, std::atomic<int64_t> &delay_us)
+{
+    DnsResolverOptions opts;
+    opts.workers = workers;
+    opts.cache_entries = 4 * hot + 1024;
+    DnsResolver resolver(opts);
+
+    std::vector<std::string> hot_names;
+    for (size_t i = 0; i < hot; ++i)
+        hot_names.push_back("hot" + std::to_string(i) + ".bench.example");
+    delay_us = 0; // warm the cache at full speed
+    std::vector<DnsQuery> warm;
+    for (const std::string &n : hot_names)
+        warm.push_back(DnsQuery{n, 1});
+    resolver.submit(std::move(warm));
+    std::vector<DnsBatch> warmed;
+    while (warmed.empty())
+    {
+        pollfd pfd{resolver.completion_fd(), POLLIN, 0};
+        poll(&pfd, 1, 100);
+        resolver.take_completed(warmed);
+    }
+    delay_us = int64_t(upstream_ms) * 1000;
+
+    std::mt19937_64 rng(7); // the same query mix for every run
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    Latencies hits, misses;
+    size_t miss_seq = 0, failed = 0, outstanding = 0;
+    std::unordered_map<uint64_t, Clock::time_point> miss_due; // batch id -> scheduled time
+    std::vector<DnsBatch> done;
+    auto collect = [&]()
+    {
+        done.clear();
+        resolver.take_completed(done);
+        auto now = Clock::now();
+        for (const DnsBatch &b : done)
+        {
+            misses.us.push_back(since_us(miss_due[b.id], now));
+            miss_due.erase(b.id);
+            failed += b.results.front().answers.empty();
+            outstanding--;
+        }
+    };
+
+    const size_t total = static_cast<size_t>(double(rate) * duration);
+    const auto interval = std::chrono::duration<double>(1.0 / double(rate));
+    const auto start = Clock::now();
+    for (size_t i = 0; i < total; ++i)
+    {
+        auto due = start + std::chrono::duration_cast<Clock::duration>(interval * double(i));
+
+        // Until the next query is due, the front end only handles completions
+        for (auto now = Clock::now(); now < due; now = Clock::now())
+        {
+            auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(due - now);
+            timespec ts{static_cast<time_t>(wait.count() / 1000000000), static_cast<long>(wait.count() % 1000000000)};
+            pollfd pfd{resolver.completion_fd(), POLLIN, 0};
+            if (ppoll(&pfd, 1, &ts, nullptr) > 0)
+                collect();
+        }
+
+        if (uniform(rng) >= miss_share)
+        {
+            DnsAnswer a;
+            resolver.lookup_cached(hot_names[rng() % hot_names.size()], 1, a);
+            hits.us.push_back(since_us(due, Clock::now()));
+            continue;
+        }
+
+        std::string name = "miss" + std::to_string(miss_seq++) + ".bench.example";
+        if (pool)
+        {
+            miss_due[resolver.submit({DnsQuery{name, 1}})] = due;
+            outstanding++;
+        }
+        else
+        {
+            DnsAnswer a = resolver.resolve(name, 1);
+            failed += a.answers.empty();
+            misses.us.push_back(since_us(due, Clock::now()));
+        }
+    }
+    double issue_secs = std::chrono::duration<double>(Clock::now() - start).count();
+    while (outstanding > 0)
+    {
+        pollfd pfd{resolver.completion_fd(), POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+            collect();
+    }
+
+    std::cout << "  " << (pool ? "pool  " : "inline") << " upstream " << upstream_ms << " ms: issued in "
+              << issue_secs << " s; hits " << hits.us.size() << " p50=" << hits.percentile(0.50)
+              << "us p99=" << hits.percentile(0.99) << "us p99.9=" << hits.percentile(0.999)
+              << "us; misses " << misses.us.size() << " p50=" << misses.percentile(0.50) / 1000
+              << "ms p99=" << misses.percentile(0.99) / 1000 << "ms";
+    if (failed)
+        std::cout << " (" << failed << " failed)";
+    std::cout << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rate = 5000;
+    double duration = 3;
+    size_t hot = 1000;
+    double miss_share = 0.002;
+    unsigned workers = 4;
+    std::vector<unsigned> upstream_ms = {0, 20, 200, 1000};
+    std::vector<bool> modes = {true, false};
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--rate=", 7) == 0)
+            rate = static_cast<size_t>(std::max(1, std::atoi(argv[i] + 7)));
+        else if (std::strncmp(argv[i], "--duration=", 11) == 0)
+            duration = std::max(0.1, std::atof(argv[i] + 11));
+        else if (std::strncmp(argv[i], "--hot=", 6) == 0)
+            hot = static_cast<size_t>(std::max(1, std::atoi(argv[i] + 6)));
+        else if (std::strncmp(argv[i], "--miss-share=", 13) == 0)
+            miss_share = std::atof(argv[i] + 13);
+        else if (std::strncmp(argv[i], "--workers=", 10) == 0)
+            workers = static_cast<unsigned>(std::max(1, std::atoi(argv[i] + 10)));
+        else if (std::strncmp(argv[i], "--upstream-ms=", 14) == 0)
+        {
+            upstream_ms.clear();
+            for (const char *p = argv[i] + 14; *p;)
+            {
+                upstream_ms.push_back(static_cast<unsigned>(std::max(0, std::atoi(p))));
+                const char *comma = std::strchr(p, ',');
+                p = comma ? comma + 1 : p + std::strlen(p);
+            }
+        }
+        else if (std::strcmp(argv[i], "--mode=pool") == 0)
+            modes = {true};
+        else if (std::strcmp(argv[i], "--mode=inline") == 0)
+            modes = {false};
+        else if (std::strcmp(argv[i], "--mode=pool,inline") == 0)
+            modes = {true, false};
+        else
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    prctl(PR_SET_TIMERSLACK, 1UL); // wake on schedule, not up to 50us late
+    std::cout << rate << " queries/s for " << duration << " s, " << (miss_share * 100) << "% misses, "
+              << hot << " hot names, " << workers << " miss workers\n";
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &addr_len) < 0)
+    {
+        std::cerr << "Cannot open the stand-in server: " << std::strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    std::atomic<int64_t> delay_us{0};
+    std::atomic<bool> stop{false};
+    std::thread server(serve_stand_in, fd, std::cref(delay_us), std::cref(stop));
+    set_upstream_servers({"127.0.0.1"}, ntohs(addr.sin_port));
+
+    for (unsigned ms : upstream_ms)
+    {
+        for (bool pool : modes)
+            run(pool, rate, duration, hot, miss_share, workers, ms, delay_us);
+    }
+
+    stop = true;
+    server.join();
+    close(fd);
+    return EXIT_SUCCESS;
+}
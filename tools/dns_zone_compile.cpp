@@ -0,0 +1,77 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include "local_zone.h"
+
+static void print_usage(const char *prog_name)
+{
+    std::cout << "Usage:\n"
+              << "  " << prog_name << " [--ttl=SECONDS] -o <image> <hosts-or-zone-file>...\n"
+              << "Examples:\n"
+              << "  " << prog_name << " -o local.zimg /etc/hosts\n"
+              << "  " << prog_name << " --ttl=300 -o internal.zimg internal.zone extra.hosts\n";
+}
+
+int main(int argc, char *argv[])
+{
+    std::string out_path;
+    std::vector<std::string> inputs;
+    uint32_t default_ttl = 3600;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if (std::strncmp(argv[i], "--ttl=", 6) == 0)
+        {
+            if (!parse_zone_ttl(argv[i] + 6, default_ttl))
+            {
+                std::cerr << "Error: Bad TTL \"" << (argv[i] + 6) << "\".\n";
+                return EXIT_FAILURE;
+            }
+        }
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "Error: Unrecognized option \"" << argv[i] << "\".\n";
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            inputs.emplace_back(argv[i]);
+        }
+    }
+
+    if (out_path.empty() || inputs.empty())
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+
+    std::vector<ZoneRecord> records;
+    for (const auto &path : inputs)
+    {
+        if (!parse_zone_source(path, default_ttl, records))
+            return EXIT_FAILURE;
+    }
+    size_t parsed = records.size();
+
+    if (!compile_zone_image(std::move(records), out_path))
+        return EXIT_FAILURE;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    LocalZone check;
+    if (!check.open(out_path))
+        return EXIT_FAILURE;
+    std::cout << "Compiled " << parsed << " entries into " << check.size()
+              << " records (" << out_path << ") in " << ms << " ms\n";
+    return EXIT_SUCCESS;
+}